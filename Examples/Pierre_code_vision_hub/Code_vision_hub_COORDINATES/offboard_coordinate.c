@@ -16,7 +16,7 @@
 
 #define FLIGHT_ALTITUDE	-1.5f
 #define RATE			30	// loop rate hz
-#define STEPS			25 000  // We chose arbitrarily 25 000 as the maximum number of sub-points (so the drone can approximatly fly 500m)
+#define SUB_PTS_PER_M	50		// We choose arbitrarily to put 50 points for each meter of the path
 
 #define MAX_LINE 256	// Maximum length of a CSV file line.
 
@@ -25,86 +25,149 @@ static int running = 0;
 static pthread_t offboard_coordinate_thread_id;
 static int en_debug = 0;
 
-static mavlink_set_position_target_local_ned_t path[STEPS];
+static mavlink_set_position_target_local_ned_t* path = NULL;	// sized for the CSV file loaded, no fixed maximum
 static mavlink_set_position_target_local_ned_t home_position;
+static mavlink_set_position_target_local_ned_t path_origin;	// home when the path first started
+static int n_path = 0;			// number of sub-points generated
+static int path_progress = -1;	// last sub-point sent, -1 until the path starts
 
 
 
-typedef struct {		//Definition of CoordinateList which is composed of 3 lists and an int.
-    float coorx[STEPS]; //These lists will contain the x, y and z coordinates of each points entered in the CSV file.
-    float coory[STEPS]; 
-    float coorz[STEPS];
+typedef struct {		// Definition of CoordinateList which is composed of 3 lists and an int.
+    float* coorx;		// These lists will contain the x, y and z coordinates of each points entered in the CSV file,
+    float* coory;		// they grow as the file is read so there is no maximum number of points.
+    float* coorz;
     int nb_pts; 		// Number of points in the CSV file.
-} CoordinateList;		// CoordinateList is an object which will be useful for data collection and use.
+    int capacity;		// Number of points the lists have room for.
+} CoordinateList;
 
 
-CoordinateList get_csv_coordinates()	// This method allows the data collection from the CSV file and organizes them in a CoordinateList
+static void free_coordinates(CoordinateList* coordinates)
 {
-    CoordinateList coordinates = { .nb_pts = 0 };	// Initialization of the variable coordinates of type CoordinateList, and initialization of nb_pts at 0
+    free(coordinates->coorx);
+    free(coordinates->coory);
+    free(coordinates->coorz);
+    memset(coordinates, 0, sizeof(*coordinates));
+}
+
+
+// Reads the x, y and z columns of the CSV file. Blank lines, # comments and the header line
+// "coor x,coor y,coor z" before the first point are skipped, any other line that is not 3 numbers
+// is reported with its line number and the load fails.
+static int get_csv_coordinates(CoordinateList* coordinates)
+{
+    const char* file_name = "/home/visionhub_ws/src/voxl-vision-hub/coordinates.csv";
+    memset(coordinates, 0, sizeof(*coordinates));
 
-    FILE *file = fopen("/home/visionhub_ws/src/voxl-vision-hub/coordinates.csv", "r"); // Opening in reading mode of the CSV file
+    FILE *file = fopen(file_name, "r"); // Opening in reading mode of the CSV file
     if (!file) {
         perror("The program cannot read the file");
-        return coordinates;
+        return -1;
     }
 
     char line[MAX_LINE];	// creation of a table of string with 256 characters
-    
-    while (fgets(line, MAX_LINE, file)) {		// While there is a readable line, it reads every line and puts the data in the list of list
-        line[strcspn(line, "\n")] = '\0'; 		// Erases the last character "\n" of each line and replaces it by "\0"
-
-        char *token = strtok(line, ",");		// Splits the columns on each line by a ","
-        if (token != NULL) {
-            coordinates.coorx[coordinates.nb_pts] = atof(token);  		// Adds the coordinate x in the table coordinates.coorx
-
-            token = strtok(NULL, ",");
-            if (token != NULL) {
-                coordinates.coory[coordinates.nb_pts] = atof(token);	// Adds the coordinate y in the table coordinates.coory
+    int line_nb = 0;		// line number in the file, for error messages
+    int header_skipped = 0;
+
+    while (fgets(line, MAX_LINE, file)) {		// While there is a readable line, it reads every line
+        line_nb++;
+        line[strcspn(line, "\r\n")] = '\0'; 	// Erases the end of line
+
+        const char* text = line + strspn(line, " \t");
+        if (text[0] == '\0' || text[0] == '#') continue;		// blank line or comment
+
+        float x, y, z;
+        char extra;
+        if (sscanf(text, "%f ,%f ,%f %c", &x, &y, &z, &extra) != 3) {
+            if (coordinates->nb_pts == 0 && !header_skipped) {		// the header comes before any point
+                header_skipped = 1;
+                continue;
             }
+            fprintf(stderr, "ERROR: %s:%d: expected x,y,z\n", file_name, line_nb);
+            fclose(file);
+            free_coordinates(coordinates);
+            return -1;
+        }
 
-            token = strtok(NULL, ",");
-            if (token != NULL) {
-                coordinates.coorz[coordinates.nb_pts] = atof(token);	// Adds the coordinate z in the table coordinates.coorz
+        if (coordinates->nb_pts == coordinates->capacity) {		// Makes room for more points
+            int capacity = coordinates->capacity ? coordinates->capacity * 2 : 64;
+            float* coorx = realloc(coordinates->coorx, capacity * sizeof(float));
+            if (coorx) coordinates->coorx = coorx;
+            float* coory = realloc(coordinates->coory, capacity * sizeof(float));
+            if (coory) coordinates->coory = coory;
+            float* coorz = realloc(coordinates->coorz, capacity * sizeof(float));
+            if (coorz) coordinates->coorz = coorz;
+            if (!coorx || !coory || !coorz) {
+                fprintf(stderr, "ERROR: out of memory reading %s\n", file_name);
+                fclose(file);
+                free_coordinates(coordinates);
+                return -1;
             }
-
-            coordinates.nb_pts++;				// Increments nb_pts counter for each points read
+            coordinates->capacity = capacity;
         }
+
+        coordinates->coorx[coordinates->nb_pts] = x;
+        coordinates->coory[coordinates->nb_pts] = y;
+        coordinates->coorz[coordinates->nb_pts] = z;
+        coordinates->nb_pts++;				// Increments nb_pts counter for each points read
     }
 
     fclose(file);		// close the CSV file
 
     // Print data of the points
-    for (int i = 0; i < coordinates.nb_pts; i++) {
+    for (int i = 0; i < coordinates->nb_pts; i++) {
         printf("x : %f, y : %f, z : %f\n",
-               coordinates.coorx[i],
-               coordinates.coory[i],
-               coordinates.coorz[i]);
+               (double)coordinates->coorx[i],
+               (double)coordinates->coory[i],
+               (double)coordinates->coorz[i]);
     }
-    return coordinates;
+    return 0;
+}
+
+
+// number of sub-points between point i and point i+1
+static int _nb_sub_pts(const float* coorx, const float* coory, const float* coorz, int i)
+{
+	float dist = sqrt(pow((coorx[i+1]-coorx[i]), 2) + 		// We calculate the distance in meter between 2 points
+                      pow((coory[i+1]-coory[i]), 2) + 
+                      pow((coorz[i+1]-coorz[i]), 2));
+	return floor(dist*SUB_PTS_PER_M);
 }
 
 
 // follow a path with coordinates
 static void _init_path_coordinate(void)
 {
-    CoordinateList list = get_csv_coordinates();		// Creates a CoordinateList with data from the CSV file
+    CoordinateList list;		// x, y and z coordinates of the CSV file, left empty if it failed to load
+    get_csv_coordinates(&list);
+    const float* coorx = list.coorx;
+    const float* coory = list.coory;
+    const float* coorz = list.coorz;
 
     int size = list.nb_pts;		// Gets the number of point in the CoordinateList
 
 	if(size > 1){			// Verifies if there is at least one point
 
 		int cpt = 0;		// Initializes cpt counter to 0 which will count the total number of sub-points
-		float dist; 		// We suppose that the coordinates are in meters 
 		int nb_sub_pts; 	// Creates an int nb_sub_pts which correspond to the number of sub-points between 2 points
 		float v = 0.1;  	// velocity = 0.1m/s
 		float a = 0.0;  	// acceleration = null
 
+		// First pass counts the sub-points so the path is allocated once at exactly the right size
+		int total = 0;
+		for(int i=0; i<size-1; i++){
+			total += _nb_sub_pts(coorx, coory, coorz, i);
+		}
+		free(path);
+		path = malloc((total ? total : 1) * sizeof(mavlink_set_position_target_local_ned_t));
+		if(path == NULL){
+			fprintf(stderr, "ERROR: out of memory for %d sub-points\n", total);
+			size = 0;
+		}
+
 		for(int i=0; i<size-1; i++){ 		// Loop through the list of coordinates
 			
-			dist = sqrt(pow((list.coorx[i+1]-list.coorx[i]), 2) + 		// We calculate the distance in meter between 2 points
-                        pow((list.coory[i+1]-list.coory[i]), 2) + 
-                        pow((list.coorz[i+1]-list.coorz[i]), 2));
-			nb_pts = floor(dist*50); 		// We choose arbitrarily to put 50 points for each meter of the path
+			nb_sub_pts = _nb_sub_pts(coorx, coory, coorz, i);
 
 			for(int k=0; k<nb_sub_pts; k++){		// For each sub-points between the 2 same points : 
 
@@ -116,9 +179,9 @@ static void _init_path_coordinate(void)
 				path[cpt+k].target_component = AUTOPILOT_COMPID;
 
 				// Adds a new sub-point of coordinate x, y and z in the path
-				path[cpt+k].x = (list.coorx[i+1]-list.coorx[i])*k/nb_sub_pts + list.coorx[i];	
-				path[cpt+k].y = (list.coory[i+1]-list.coory[i])*k/nb_sub_pts + list.coory[i];
-				path[cpt+k].z = (list.coorz[i+1]-list.coorz[i])*k/nb_sub_pts + list.coorz[i];
+				path[cpt+k].x = (coorx[i+1]-coorx[i])*k/nb_sub_pts + coorx[i];	
+				path[cpt+k].y = (coory[i+1]-coory[i])*k/nb_sub_pts + coory[i];
+				path[cpt+k].z = (coorz[i+1]-coorz[i])*k/nb_sub_pts + coorz[i];
 
 				// Adds the velocity of the drone for this new sub-point
 				path[cpt+k].vx = v;
@@ -126,9 +189,9 @@ static void _init_path_coordinate(void)
 				path[cpt+k].vz = v;
 
 				// Adds the acceleration of the drone for this new sub-point
-				path[cpt+k].ax = a;
-				path[cpt+k].ay = a;
-				path[cpt+k].az = a;
+				path[cpt+k].afx = a;
+				path[cpt+k].afy = a;
+				path[cpt+k].afz = a;
 				
 				// Adds the yaw of the drone for this new sub-point
 				path[cpt+k].yaw = 0;
@@ -136,16 +199,18 @@ static void _init_path_coordinate(void)
 
 			cpt = cpt + nb_sub_pts;		// Incrementation of the counter 
 		}
+		n_path = cpt;
 	}
 
 	else{
 		printf("error : the coordinates should contains at least 2 points") ;
 	}
+	free_coordinates(&list);
 
     // now set home position
 	// this will move later if figure_eight_move_home is enabled
 	home_position.time_boot_ms = 0;
-	home_position.coordinate_frame = path[0].coordinate_frame;
+	home_position.coordinate_frame = MAV_FRAME_LOCAL_NED;
 	home_position.type_mask =   POSITION_TARGET_TYPEMASK_VX_IGNORE |
 								POSITION_TARGET_TYPEMASK_VY_IGNORE |
 								POSITION_TARGET_TYPEMASK_VZ_IGNORE |
@@ -155,8 +220,8 @@ static void _init_path_coordinate(void)
 								POSITION_TARGET_TYPEMASK_YAW_RATE_IGNORE;
 	home_position.x = 0.0f;
 	home_position.y = 0.0f;
-	home_position.z = path[0].z;
-	home_position.yaw = path[0].yaw;
+	home_position.z = n_path > 0 ? path[0].z : FLIGHT_ALTITUDE;	// no path loaded, hold at the default altitude
+	home_position.yaw = 0;
 	home_position.target_system = 0; // will reset later when sending
 	home_position.target_component = AUTOPILOT_COMPID;
 
@@ -167,13 +232,13 @@ static void _init_path_coordinate(void)
 
 static void _send_position_in_path(int i)
 {
-	if(i>=STEPS || i<0) return;
+	if(i>=n_path || i<0) return;
 
 	mavlink_set_position_target_local_ned_t pos = path[i];
 	if(coordinate_move_home){
-		pos.x += home_position.x;
-		pos.y += home_position.y;
-		pos.z  = home_position.z;
+		pos.x += path_origin.x;
+		pos.y += path_origin.y;
+		pos.z  = path_origin.z;
 	}
 	mavlink_io_send_fixed_setpoint(autopilot_monitor_get_sysid(),VOXL_COMPID,pos);
 
@@ -197,6 +262,43 @@ static void _send_home_position(void)
 
 
 
+// first time through start the path at 0. After falling out of offboard mode,
+// resume from the closest sub-point not yet flown instead of starting over.
+static int _start_or_resume_index(void)
+{
+	if(path_progress < 0 || n_path <= 0){
+		path_origin = home_position;
+		return 0;
+	}
+	if(path_progress > n_path-1) path_progress = n_path-1;
+
+	mavlink_odometry_t odom = autopilot_monitor_get_odometry();
+	float x = odom.x;
+	float y = odom.y;
+	float z = odom.z;
+	if(coordinate_move_home){
+		x -= path_origin.x;
+		y -= path_origin.y;
+	}
+
+	int best = path_progress;
+	float best_d2 = -1.0f;
+	for(int k=path_progress; k<n_path; k++){
+		float dx = path[k].x - x;
+		float dy = path[k].y - y;
+		float dz = coordinate_move_home ? 0.0f : path[k].z - z;
+		float d2 = dx*dx + dy*dy + dz*dz;
+		if(best_d2 < 0.0f || d2 < best_d2){
+			best_d2 = d2;
+			best = k;
+		}
+	}
+	printf("resuming path at sub-point %d of %d\n", best, n_path);
+	return best;
+}
+
+
+
 static void* _offboard_coordinate_thread_func(__attribute__((unused)) void* arg)
 {
 	// for loop sleep
@@ -222,7 +324,7 @@ HOME:
 		if(my_loop_sleep(RATE, &next_time)){
 			fprintf(stderr, "WARNING thread fell behind\n");
 		}
-		fflush(stdout);i
+		fflush(stdout);
 	}
 
 	// give the system 2 seconds to get to home position
@@ -238,14 +340,15 @@ HOME:
 		}
 	}
 
-	// now begin path,
-	i=0;
+	// now begin path, or pick it back up where we left off
+	i = _start_or_resume_index();
 	while(running){
 		// return to home position if px4 falls out of offboard mode or disarms
 		if(!autopilot_monitor_is_armed_and_in_offboard_mode()) goto HOME;
 		_send_position_in_path(i);
+		path_progress = i;
 		i++;
-		if(i>=STEPS) i=0;
+		if(i>=n_path) i=0;
 		if(my_loop_sleep(RATE, &next_time)){
 			fprintf(stderr, "WARNING thread fell behind\n");
 		}
@@ -259,6 +362,8 @@ HOME:
 
 int offboard_coordinate_init(void)
 {
+	// a restarted path is reloaded from scratch, so forget where the last one got to
+	path_progress = -1;
 	running = 1;
 	pipe_pthread_create(&offboard_coordinate_thread_id, _offboard_coordinate_thread_func, NULL, OFFBOARD_THREAD_PRIORITY);
 	return 0;
@@ -272,6 +377,10 @@ int offboard_coordinate_stop(int blocking)
 	running = 0;
 	if(blocking){
 		pthread_join(offboard_coordinate_thread_id, NULL);
+		free(path);
+		path = NULL;
+		n_path = 0;
+		path_progress = -1;
 	}
 	return 0;
 }
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN 16
+
+// each allocation is preceded by its size so arena_realloc knows what to copy
+typedef struct alloc_header_t {
+    size_t size;
+    size_t pad;
+} alloc_header_t;
+
+struct arena_block_t {
+    arena_block_t* next;
+    size_t size;            // usable bytes in data
+    size_t used;
+    size_t pad;
+    unsigned char data[];
+};
+
+_Static_assert(sizeof(alloc_header_t) % ARENA_ALIGN == 0, "header breaks alignment");
+_Static_assert(sizeof(arena_block_t) % ARENA_ALIGN == 0, "block header breaks alignment");
+
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+
+static alloc_header_t* header_of(void* ptr)
+{
+    return (alloc_header_t*)ptr - 1;
+}
+
+static arena_block_t* new_block(arena_t* a, size_t need, size_t reserve)
+{
+    size_t size = need + reserve;
+    if (size < ARENA_BLOCK_SIZE) size = ARENA_BLOCK_SIZE;
+    arena_block_t* b = malloc(sizeof(arena_block_t) + size);
+    if (!b) return NULL;
+    b->next = a->head;
+    b->size = size;
+    b->used = 0;
+    a->head = b;
+    return b;
+}
+
+
+// allocate with room to grow in place by reserve bytes if a new block is needed
+static void* alloc_reserve(arena_t* a, size_t size, size_t reserve)
+{
+    size_t need = sizeof(alloc_header_t) + ALIGN_UP(size);
+    arena_block_t* b = a->head;
+    if (!b || b->size - b->used < need) {
+        b = new_block(a, need, reserve);
+        if (!b) return NULL;
+    }
+
+    alloc_header_t* h = (alloc_header_t*)(b->data + b->used);
+    h->size = size;
+    b->used += need;
+    a->used += size;
+    a->last = h + 1;
+    return a->last;
+}
+
+
+void* arena_alloc(arena_t* a, size_t size)
+{
+    return alloc_reserve(a, size, 0);
+}
+
+
+void* arena_realloc(arena_t* a, void* ptr, size_t size)
+{
+    if (!ptr) return arena_alloc(a, size);
+
+    alloc_header_t* h = header_of(ptr);
+    size_t old = h->size;
+
+    // the newest allocation ends at the block's fill mark, move the mark
+    arena_block_t* b = a->head;
+    if (ptr == a->last && b) {
+        size_t start = (unsigned char*)ptr - b->data;
+        if (start + ALIGN_UP(size) <= b->size) {
+            b->used = start + ALIGN_UP(size);
+            h->size = size;
+            a->used = a->used - old + size;
+            return ptr;
+        }
+    }
+
+    if (size <= old) {
+        h->size = size;
+        return ptr;
+    }
+    // an array being grown is likely to grow again, leave it room to do so in place
+    void* fresh = alloc_reserve(a, size, ALIGN_UP(size));
+    if (!fresh) return NULL;
+    memcpy(fresh, ptr, old);
+    return fresh;
+}
+
+
+void arena_release(arena_t* a)
+{
+    arena_block_t* b = a->head;
+    while (b) {
+        arena_block_t* next = b->next;
+        free(b);
+        b = next;
+    }
+    memset(a, 0, sizeof(*a));
+}
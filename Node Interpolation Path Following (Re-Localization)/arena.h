@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Bump allocator for data that lives and dies together, such as one loaded
+ * mission.
+ *
+ * Memory comes from a chain of blocks that only grows, so there is no per
+ * allocation bookkeeping and nothing to free piece by piece. The most recent
+ * allocation can be grown in place, which is how arrays filled one element
+ * at a time avoid copying. arena_release() returns everything at once.
+ */
+
+typedef struct arena_block_t arena_block_t;
+
+typedef struct arena_t {
+    arena_block_t* head;    // block being allocated from, older ones chained behind
+    void* last;             // most recent allocation, the one that can grow in place
+    size_t used;            // bytes handed out, for reporting
+} arena_t;
+
+
+/**
+ * @brief      allocate size bytes, aligned for any type
+ *
+ * @return     pointer or NULL when out of memory
+ */
+void* arena_alloc(arena_t* a, size_t size);
+
+/**
+ * @brief      resize an allocation like realloc()
+ *
+ *             Grows in place when ptr is the most recent allocation and its
+ *             block has room, otherwise copies into a new allocation and the
+ *             old space is only reclaimed by arena_release(). ptr may be NULL.
+ *
+ * @return     pointer or NULL when out of memory, ptr stays valid on failure
+ */
+void* arena_realloc(arena_t* a, void* ptr, size_t size);
+
+// free every block and reset the arena for reuse
+void arena_release(arena_t* a);
+
+#endif // ARENA_H
@@ -174,7 +174,7 @@ int extrinsics_fetch_frame_to_body(char* frame, rc_matrix_t* R, rc_vector_t* T)
  *         vio_data_t type. Default is ov for openvins. If no data is available on this\n\
  *         pipe then voxl-vision-hub will subscribe to the primary vio_pipe instead.\n\
  *         Set to an empty string to disable. Default: ov\n\
- *\n\eight
+ *\n\
  * en_reset_vio_if_initialized_inverted:\n\
  *         For VIO algorithms like qVIO that can initialize in any orientation\n\
  *         and output their estimate of the gravity vector, we suggest leaving\n\
@@ -233,7 +233,8 @@ int extrinsics_fetch_frame_to_body(char* frame, rc_matrix_t* R, rc_vector_t* T)
  *\n\
  * offboard_mode: The following are valid strings\n\
  *     off: VVPX4 will not send any offboard commands to PX4\n\
- *     figure_eight: Default value, VVPX4 commands PX4 to fly a figure 8 path\n\
+ *     lines:      Default value, fly the path in /data/path_points.csv\n\
+ *     figure_eight: VVPX4 commands PX4 to fly a figure 8 path\n\
  *     follow_tag: Drone will follow an apriltag around. Very dangerous, not\n\
  *                 recommended for customer use, for ModalAI R&D only.\n\
  *     trajectory: VVPX4 receives polynomial trajectories by pipe and commands\n\
@@ -244,6 +245,16 @@ int extrinsics_fetch_frame_to_body(char* frame, rc_matrix_t* R, rc_vector_t* T)
  *                 it is able to regain the link. This mode will notice when the\n\
  *                 RC link goes away and sends a command to px4 to enter offboard mode.\n\
  *     wps:        read waypoints in local coordinate system\n\
+ *     square:     fly a square\n\
+ *     coordinates: fly the coordinates in a CSV file\n\
+ *\n\
+ *     The mode can be changed without a restart, even in flight:\n\
+ *     echo \"mode wps\" > /run/mpa/vvhub_offboard/control\n\
+ *\n\
+ * offboard_rate_hz:\n\
+ *         Rate offboard setpoints are sent to PX4 at, 10 to 250. Setpoints\n\
+ *         are evaluated at the exact tick time, so faster streaming gives\n\
+ *         smoother references without using more path memory. Default 30\n\
  *\n\
  * follow_tag_id:\n\
  *         Apriltag ID to follow in follow_tag mode\n\
@@ -283,6 +294,67 @@ int extrinsics_fetch_frame_to_body(char* frame, rc_matrix_t* R, rc_vector_t* T)
  * backtrack_rc_thresh:\n\
  *         Value above which backtrack is considered enabled on the configured RC channel.\n\
  *\n\
+ * lines_vmax, lines_amax, lines_jmax:\n\
+ *         Speed (m/s), acceleration (m/s^2) and jerk (m/s^3) limits used to plan\n\
+ *         the velocity profile along the path in lines mode.\n\
+ *\n\
+ * lines_corner_deviation:\n\
+ *         Junction deviation in meters used to slow down for corners between\n\
+ *         path nodes in lines mode. Larger values take corners faster.\n\
+ *\n\
+ * lines_en_carrot:\n\
+ *         Disabled by default. When enabled, lines mode tracks progress by\n\
+ *         finding the point on the path closest to the vehicle every tick and\n\
+ *         sends the setpoint lines_lookahead_m ahead of it, instead of replaying\n\
+ *         the path open loop. The setpoint then waits for the vehicle after a\n\
+ *         gust or relocalization jump instead of running away from it.\n\
+ *\n\
+ * lines_lookahead_m:\n\
+ *         Distance along the path between the closest point and the setpoint\n\
+ *         in carrot mode. Default 0.5\n\
+ *\n\
+ * lines_interp:\n\
+ *         How the path nodes are joined in lines mode. One of:\n\
+ *         linear:      straight lines, slows down for every corner (default)\n\
+ *         catmull_rom: smooth curve through every node\n\
+ *         bspline:     smoother curve that cuts inside the nodes\n\
+ *\n\
+ * lines_chord_tol_m:\n\
+ *         How far the flown path may cut inside the spline between samples.\n\
+ *         Samples are spaced by curvature to stay within it, so straight\n\
+ *         stretches need very few. Default 0.02\n\
+ *\n\
+ * lines_en_reloc:\n\
+ *         Disabled by default. When enabled, lines mode matches tag detections\n\
+ *         against the surveyed poses in /data/tag_map.csv and corrects every\n\
+ *         setpoint for the drift between local frame and the tag map frame\n\
+ *         the path is written in. Needs coordinate_move_home and\n\
+ *         en_tag_fixed_frame disabled, the path must be in map coordinates.\n\
+ *\n\
+ * lines_reloc_filter:\n\
+ *         How lines mode smooths its tag corrections. One of:\n\
+ *         average: moving average over fixed_frame_filter_len tag frames (default)\n\
+ *         kalman:  follows drift faster when VIO quality drops, smoother otherwise\n\
+ *\n\
+ * lines_reloc_cam:\n\
+ *         Extrinsics frame of the camera tags are detected with, used to\n\
+ *         predict which tags can be seen from each part of the path.\n\
+ *         Default tracking\n\
+ *\n\
+ * lines_reloc_fov_deg:\n\
+ *         Full field of view of that camera. Default 120\n\
+ *\n\
+ * lines_reloc_range_m:\n\
+ *         Farthest a tag is expected to be detected from. Detections of tags\n\
+ *         not predicted visible are rejected, and tag frames are skipped\n\
+ *         where none are expected. 0 disables the prediction. Default 6.0\n\
+ *\n\
+ * lines_reloc_learn:\n\
+ *         Learn the poses of tags missing from the tag map while relocalized.\n\
+ *         They are saved to /data/tag_map_learned.bin on disarm and tags seen\n\
+ *         consistently enough join the map on the next mission load.\n\
+ *         Surveyed poses always win. Default false\n\
+ *\n\
  * ##############################################################################\n\
  * ## Fixed Frame Tag Relocalization\n\
  * ##############################################################################\n\
@@ -384,6 +456,31 @@ int extrinsics_fetch_frame_to_body(char* frame, rc_matrix_t* R, rc_vector_t* T)
  *    y_fov_deg:    FOV of the sensor in the y direction, typically height\n\
  *    conf_cutoff:  discard points below this confidence, only applicable to TOF\n\
  *\n\
+ *\n\
+ * ##############################################################################\n\
+ * ## Real-Time Thread Placement\n\
+ * ## Keeps the control loop on its own cores and its memory resident\n\
+ * ##############################################################################\n\
+ *\n\
+ * rt_mlockall:\n\
+ *         Lock vision hub's memory in RAM, including memory allocated\n\
+ *         later such as loaded missions, so the offboard loop never waits\n\
+ *         on a page fault. Only pages actually used are locked, unused\n\
+ *         thread stack and heap space is not. Default true\n\
+ *\n\
+ * rt_threads:\n\
+ *         Array of threads to pin to cores and give a priority, up to 8.\n\
+ *         Threads not listed run as they were created.\n\
+ *\n\
+ * Fields:\n\
+ *    name:         offboard. Only the offboard thread applies its entry for\n\
+ *                      now, other names are reserved for threads outside this\n\
+ *                      module and are ignored with a warning\n\
+ *    cpus:         cores the thread may run on, e.g. [7]. Empty to let it run on\n\
+ *                      any core. On VOXL2 cores 4-6 are the big cores and 7 the\n\
+ *                      prime core, keep camera servers off the cores used here\n\
+ *    priority:     SCHED_FIFO priority 1-99, -1 to keep the default\n\
+ *\n\
  */\n"
 
 
@@ -418,6 +515,7 @@ int en_hitl;
 
 // offboard mode config
 offboard_mode_t offboard_mode;
+int offboard_rate_hz;
 int follow_tag_id;
 int figure_eight_move_home;
 int coordinate_move_home; // We added lines 423 - 424 so the program works as a whole
@@ -437,6 +535,22 @@ int backtrack_seconds;
 int backtrack_rc_chan;
 int backtrack_rc_thresh;
 
+// offboard lines
+float lines_vmax;
+float lines_amax;
+float lines_jmax;
+float lines_corner_deviation;
+int lines_en_carrot;
+float lines_lookahead_m;
+lines_interp_t lines_interp;
+float lines_chord_tol_m;
+int lines_en_reloc;
+lines_reloc_filter_t lines_reloc_filter;
+char lines_reloc_cam[64];
+float lines_reloc_fov_deg;
+float lines_reloc_range_m;
+int lines_reloc_learn;
+
 // fixed frame
 int en_tag_fixed_frame;
 int fixed_frame_filter_len;
@@ -461,12 +575,19 @@ float voa_pie_bin_depth_m;
 float voa_send_rate_hz;
 voa_input_t voa_inputs[MAX_VOA_INPUTS];
 
+// real-time thread placement
+int rt_mlockall;
+int n_rt_threads;
+rt_thread_cfg_t rt_threads[MAX_RT_THREADS];
+
 
 
 int config_file_print(void)
 {
 	const char* offboard_strings[] = OFFBOARD_STRINGS;
 	const char* voa_type_strings[] = VOA_INTPUT_TYPE_STRINGS;
+	const char* lines_interp_strings[] = LINES_INTERP_STRINGS;
+	const char* lines_reloc_filter_strings[] = LINES_RELOC_FILTER_STRINGS;
 	printf("=================================================================");
 	printf("\n");
 	printf("Parameters as loaded from config file:\n");
@@ -496,6 +617,7 @@ int config_file_print(void)
 	printf("en_hitl:                    %d\n", en_hitl);
 	printf("OFFBOARD MODE\n");
 	printf("offboard_mode:              %s\n", offboard_strings[offboard_mode]);
+	printf("offboard_rate_hz:           %d\n", offboard_rate_hz);
 	printf("follow_tag_id:              %d\n", follow_tag_id);
 	printf("figure_eight_move_home:     %d\n", figure_eight_move_home);
 	printf("square_move_home:     %d\n", square_move_home);	// We added lines 500 - 501 so the program works as a whole
@@ -509,6 +631,20 @@ int config_file_print(void)
 	printf("backtrack_seconds     :     %d\n", backtrack_seconds);
 	printf("backtrack_rc_chan     :     %d\n", backtrack_rc_chan);
 	printf("backtrack_rc_thresh   :     %d\n", backtrack_rc_thresh);
+	printf("lines_vmax:                 %f\n", (double)lines_vmax);
+	printf("lines_amax:                 %f\n", (double)lines_amax);
+	printf("lines_jmax:                 %f\n", (double)lines_jmax);
+	printf("lines_corner_deviation:     %f\n", (double)lines_corner_deviation);
+	printf("lines_en_carrot:            %d\n", lines_en_carrot);
+	printf("lines_lookahead_m:          %f\n", (double)lines_lookahead_m);
+	printf("lines_interp:               %s\n", lines_interp_strings[lines_interp]);
+	printf("lines_chord_tol_m:          %f\n", (double)lines_chord_tol_m);
+	printf("lines_en_reloc:             %d\n", lines_en_reloc);
+	printf("lines_reloc_filter:         %s\n", lines_reloc_filter_strings[lines_reloc_filter]);
+	printf("lines_reloc_cam:            %s\n", lines_reloc_cam);
+	printf("lines_reloc_fov_deg:        %f\n", (double)lines_reloc_fov_deg);
+	printf("lines_reloc_range_m:        %f\n", (double)lines_reloc_range_m);
+	printf("lines_reloc_learn:          %d\n", lines_reloc_learn);
 	printf("FIXED FRAME RELOCALIZATION\n");
 	printf("en_tag_fixed_frame:         %d\n", en_tag_fixed_frame);
 	printf("fixed_frame_filter_len:     %d\n", fixed_frame_filter_len);
@@ -586,6 +722,17 @@ int config_file_print(void)
 		printf("    y_fov_deg:          %f\n", (double)voa_inputs[i].y_fov_deg);
 		printf("    conf_cutoff:        %d\n", voa_inputs[i].conf_cutoff);
 	}
+	printf("REAL-TIME THREADS\n");
+	printf("rt_mlockall:                %d\n", rt_mlockall);
+	for(int i=0; i<n_rt_threads; i++){
+		printf("rt_thread #%d\n", i);
+		printf("    name:               %s\n", rt_threads[i].name);
+		printf("    cpus:               ");
+		if(rt_threads[i].n_cpus == 0) printf("any");
+		for(int k=0; k<rt_threads[i].n_cpus; k++) printf("%d ", rt_threads[i].cpus[k]);
+		printf("\n");
+		printf("    priority:           %d\n", rt_threads[i].priority);
+	}
 	printf("=================================================================");
 	printf("\n");
 	return 0;
@@ -621,6 +768,8 @@ int config_file_load(void)
 	const char* offboard_strings[] = OFFBOARD_STRINGS;
 	const int n_modes = sizeof(offboard_strings)/sizeof(offboard_strings[0]);
 	const char* voa_type_strings[] = VOA_INTPUT_TYPE_STRINGS;
+	const char* lines_interp_strings[] = LINES_INTERP_STRINGS;
+	const char* lines_reloc_filter_strings[] = LINES_RELOC_FILTER_STRINGS;
 
 	// some defaults that are used in multiple places
 	const float default_voa_upper_bound_m = -0.15f;
@@ -666,7 +815,8 @@ int config_file_load(void)
 	json_fetch_float_with_default(  parent, "horizon_cal_tolerance", &horizon_cal_tolerance, 0.50f);
 	json_fetch_bool_with_default(   parent, "en_hitl", &en_hitl, 0);
 	// offboard mode
-	json_fetch_enum_with_default(   parent, "offboard_mode", (int*)&offboard_mode, offboard_strings, n_modes, 1);
+	json_fetch_enum_with_default(   parent, "offboard_mode", (int*)&offboard_mode, offboard_strings, n_modes, LINES);
+	json_fetch_int_with_default(    parent, "offboard_rate_hz", &offboard_rate_hz, 30);
 	json_fetch_int_with_default(    parent, "follow_tag_id", &follow_tag_id, 0);
 	json_fetch_bool_with_default(   parent, "figure_eight_move_home", &figure_eight_move_home, 1);
 	json_fetch_bool_with_default(   parent, "square_move_home", &square_move_home, 1);	// We added lines 671 - 672 so the program works as a whole
@@ -684,6 +834,21 @@ int config_file_load(void)
 	json_fetch_float_with_default(  parent, "wps_timeout", &wps_timeout, 0.0);
 	json_fetch_float_with_default(  parent, "wps_damp", &wps_damp, 1.0);
 
+	json_fetch_float_with_default(  parent, "lines_vmax", &lines_vmax, 1.0);
+	json_fetch_float_with_default(  parent, "lines_amax", &lines_amax, 1.0);
+	json_fetch_float_with_default(  parent, "lines_jmax", &lines_jmax, 3.0);
+	json_fetch_float_with_default(  parent, "lines_corner_deviation", &lines_corner_deviation, 0.05);
+	json_fetch_bool_with_default(   parent, "lines_en_carrot", &lines_en_carrot, 0);
+	json_fetch_float_with_default(  parent, "lines_lookahead_m", &lines_lookahead_m, 0.5);
+	json_fetch_enum_with_default(   parent, "lines_interp", (int*)&lines_interp, lines_interp_strings, N_LINES_INTERP, LINES_LINEAR);
+	json_fetch_float_with_default(  parent, "lines_chord_tol_m", &lines_chord_tol_m, 0.02);
+	json_fetch_bool_with_default(   parent, "lines_en_reloc", &lines_en_reloc, 0);
+	json_fetch_enum_with_default(   parent, "lines_reloc_filter", (int*)&lines_reloc_filter, lines_reloc_filter_strings, N_LINES_RELOC_FILTER, LINES_RELOC_AVERAGE);
+	json_fetch_string_with_default( parent, "lines_reloc_cam", lines_reloc_cam, 63, "tracking");
+	json_fetch_float_with_default(  parent, "lines_reloc_fov_deg", &lines_reloc_fov_deg, 120.0);
+	json_fetch_float_with_default(  parent, "lines_reloc_range_m", &lines_reloc_range_m, 6.0);
+	json_fetch_bool_with_default(   parent, "lines_reloc_learn", &lines_reloc_learn, 0);
+
 	// fixed frame
 	json_fetch_bool_with_default(   parent, "en_tag_fixed_frame", &en_tag_fixed_frame, 0);
 	json_fetch_int_with_default(    parent, "fixed_frame_filter_len", &fixed_frame_filter_len, 5);
@@ -870,6 +1035,35 @@ int config_file_load(void)
 		}
 	}
 
+	// real-time thread placement, default entry for the offboard thread changes nothing
+	json_fetch_bool_with_default(   parent, "rt_mlockall", &rt_mlockall, 1);
+	int rt_any_cpu[1] = {0}; // default cpus list is empty, the helper still wants an array
+	cJSON* rt_threads_json = json_fetch_array_and_add_if_missing(parent, "rt_threads", &n_rt_threads);
+	if(n_rt_threads > MAX_RT_THREADS){
+		fprintf(stderr, "array of rt_threads should be no more than %d long\n", MAX_RT_THREADS);
+		return -1;
+	}
+	if(n_rt_threads == 0){
+		const char* rt_names[] = {"offboard"};
+		n_rt_threads = 1;
+		for(i=0; i<n_rt_threads; i++){
+			item = cJSON_CreateObject();
+			cJSON_AddItemToArray(rt_threads_json, item);
+			json_fetch_string_with_default(item, "name", rt_threads[i].name, RT_THREAD_NAME_LEN-1, rt_names[i]);
+			json_fetch_dynamic_vector_int_with_default(item, "cpus", rt_threads[i].cpus, &rt_threads[i].n_cpus, RT_MAX_CPUS, rt_any_cpu, 0);
+			json_fetch_int_with_default(item, "priority", &rt_threads[i].priority, -1);
+		}
+		json_set_modified_flag(1); // log that we modified the parent manually
+	}
+	else{
+		for(i=0; i<n_rt_threads; i++){
+			cJSON* item = cJSON_GetArrayItem(rt_threads_json, i);
+			json_fetch_string_with_default(item, "name", rt_threads[i].name, RT_THREAD_NAME_LEN-1, "PUT_YOUR_THREAD_NAME_HERE");
+			json_fetch_dynamic_vector_int_with_default(item, "cpus", rt_threads[i].cpus, &rt_threads[i].n_cpus, RT_MAX_CPUS, rt_any_cpu, 0);
+			json_fetch_int_with_default(item, "priority", &rt_threads[i].priority, -1);
+		}
+	}
+
 	// remove old fields to keep config file clean
 	json_remove_if_present(parent, "en_auto_level_horizon");
 	json_remove_if_present(parent, "horizon_cal_tol");
@@ -946,6 +1140,42 @@ int config_file_load(void)
 		ret = -1;
 	}
 
+	if(offboard_rate_hz<10 || offboard_rate_hz>250){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "offboard_rate_hz must be between 10 and 250\n");
+		ret = -1;
+	}
+
+	if(lines_vmax<=0.0f || lines_amax<=0.0f || lines_jmax<=0.0f){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "lines_vmax, lines_amax and lines_jmax must be >0\n");
+		ret = -1;
+	}
+
+	if(lines_corner_deviation<0.0f){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "lines_corner_deviation must be >=0\n");
+		ret = -1;
+	}
+
+	if(lines_reloc_fov_deg<=0.0f || lines_reloc_fov_deg>360.0f || lines_reloc_range_m<0.0f){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "lines_reloc_fov_deg must be in (0,360] and lines_reloc_range_m >=0\n");
+		ret = -1;
+	}
+
+	if(lines_lookahead_m<=0.0f){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "lines_lookahead_m must be >0\n");
+		ret = -1;
+	}
+
+	if(lines_chord_tol_m<=0.0f){
+		fprintf(stderr, "ERROR parsing config file:\n");
+		fprintf(stderr, "lines_chord_tol_m must be >0\n");
+		ret = -1;
+	}
+
 	if(voa_memory_s<0.05f){
 		fprintf(stderr, "ERROR parsing config file:\n");
 		fprintf(stderr, "param voa_memory_s should be >=0.05\n");
@@ -971,6 +1201,25 @@ int config_file_load(void)
 		}
 	}
 
+	long n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	for(i=0; i<n_rt_threads; i++){
+		if(strcmp(rt_threads[i].name, "offboard") != 0){
+			fprintf(stderr, "WARNING: rt_threads entry %s is not applied, only offboard is supported\n", rt_threads[i].name);
+		}
+		if(rt_threads[i].priority != -1 && (rt_threads[i].priority < 1 || rt_threads[i].priority > 99)){
+			fprintf(stderr, "ERROR parsing config file:\n");
+			fprintf(stderr, "rt_threads priority must be 1-99 or -1\n");
+			ret = -1;
+		}
+		for(int k=0; k<rt_threads[i].n_cpus; k++){
+			if(rt_threads[i].cpus[k] < 0 || rt_threads[i].cpus[k] >= n_cpus){
+				fprintf(stderr, "ERROR parsing config file:\n");
+				fprintf(stderr, "rt_threads %s lists cpu %d, this board has cpus 0-%ld\n", rt_threads[i].name, rt_threads[i].cpus[k], n_cpus-1);
+				ret = -1;
+			}
+		}
+	}
+
 	return ret;
 }
 
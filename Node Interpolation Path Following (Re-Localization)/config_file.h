@@ -65,21 +65,39 @@ int load_extrinsics_file(void);
 #define VOXL_VISION_OLD_CONF_FILE "/etc/modalai/voxl-vision-px4.conf"
 #define VOXL_VISION_HUB_CONF_FILE "/etc/modalai/voxl-vision-hub.conf"
 
-#define OFFBOARD_STRINGS {"off","figure_eight","follow_tag","trajectory","vfc","backtrack","wps","square","coordinates","lines"}
+// strings must stay in enum order, config_file_load() maps one onto the other by index
+#define OFFBOARD_STRINGS {"off","lines","figure_eight","follow_tag","trajectory","vfc","backtrack","wps","square","coordinates"}
+#define N_OFFBOARD_MODES 10
 typedef enum offboard_mode_t{
 	OFF,
-    LINES,
+	LINES,
 	FIGURE_EIGHT,
 	FOLLOW_TAG,
 	TRAJECTORY,
 	VFC,
 	BACKTRACK,
 	WPS,
-    SQUARE,     // We added the file launch indicator (SQUARE, COORDINATES; lines 75 - 76)
-    COORDINATES
+	SQUARE,
+	COORDINATES
 }offboard_mode_t;
 
 
+#define LINES_INTERP_STRINGS {"linear","catmull_rom","bspline"}
+#define N_LINES_INTERP 3
+typedef enum lines_interp_t{
+	LINES_LINEAR,
+	LINES_CATMULL_ROM,
+	LINES_BSPLINE
+}lines_interp_t;
+
+#define LINES_RELOC_FILTER_STRINGS {"average","kalman"}
+#define N_LINES_RELOC_FILTER 2
+typedef enum lines_reloc_filter_t{
+	LINES_RELOC_AVERAGE,
+	LINES_RELOC_KALMAN
+}lines_reloc_filter_t;
+
+
 #define MAX_VOA_INPUTS 6
 #define VOA_FRAME_STRING_LEN 64 // matches voxl_common_config extrinsic frame len
 #define VOA_INTPUT_TYPE_STRINGS {"point_cloud","tof","rangefinder"}
@@ -104,6 +122,16 @@ typedef struct voa_input_t{
 	int conf_cutoff; // discard points below this confidence, only applicable to TOF
 }voa_input_t;
 
+#define MAX_RT_THREADS 8
+#define RT_THREAD_NAME_LEN 16 // kernel limit on thread names, including the terminator
+#define RT_MAX_CPUS 8
+typedef struct rt_thread_cfg_t{
+	char name[RT_THREAD_NAME_LEN];
+	int n_cpus;
+	int cpus[RT_MAX_CPUS]; // cores the thread may run on, none to leave it free
+	int priority;          // SCHED_FIFO priority 1-99, -1 to keep the priority it was created with
+}rt_thread_cfg_t;
+
 typedef struct vfc_params_t{
     float rate;
 
@@ -187,6 +215,7 @@ extern int    en_set_clock_from_gps;
 extern int    en_force_onboard_mav1_mode;
 // offboard mode
 extern offboard_mode_t offboard_mode;
+extern int offboard_rate_hz;
 extern int follow_tag_id;
 extern int figure_eight_move_home;
 extern int square_move_home; // We added lines 189 - 190 so the program works as a whole
@@ -201,6 +230,20 @@ extern float max_lookahead_distance;
 extern int backtrack_seconds;
 extern int backtrack_rc_chan;
 extern int backtrack_rc_thresh;
+extern float lines_vmax;
+extern float lines_amax;
+extern float lines_jmax;
+extern float lines_corner_deviation;
+extern int lines_en_carrot;
+extern float lines_lookahead_m;
+extern lines_interp_t lines_interp;
+extern float lines_chord_tol_m;
+extern int lines_en_reloc;
+extern lines_reloc_filter_t lines_reloc_filter;
+extern char lines_reloc_cam[64];
+extern float lines_reloc_fov_deg;
+extern float lines_reloc_range_m;
+extern int lines_reloc_learn;
 // fixed frame
 extern int en_tag_fixed_frame;
 extern int fixed_frame_filter_len;
@@ -223,6 +266,10 @@ extern float voa_pie_bin_depth_m;
 // VOA input source configuration
 extern int n_voa_inputs;
 extern voa_input_t voa_inputs[MAX_VOA_INPUTS];
+// real-time thread placement
+extern int rt_mlockall;
+extern int n_rt_threads;
+extern rt_thread_cfg_t rt_threads[MAX_RT_THREADS];
 
 
 
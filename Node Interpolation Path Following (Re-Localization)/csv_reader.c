@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "csv_reader.h"
+
+#define MAX_MANTISSA 100000000000000000ULL  // stop collecting digits past 1e17
+#define MAX_EXPONENT 400
+
+// exact in double, so a mantissa below 2^53 scaled by one of these rounds once
+static const double pow10_table[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static double scale_pow10(double v, int e)
+{
+    while (e > 22) { v *= 1e22; e -= 22; }
+    while (e < -22) { v /= 1e22; e += 22; }
+    return e >= 0 ? v * pow10_table[e] : v / pow10_table[-e];
+}
+
+/*
+ * parse [+-]digits[.digits][(e|E)[+-]digits] starting at p, always with '.'
+ * as the decimal point. Returns the first character after the number, or
+ * NULL if there is no number at p.
+ */
+static const char* parse_number(const char* p, const char* end, float* out)
+{
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    uint64_t mant = 0;
+    int exp10 = 0;
+    int n_digits = 0;
+
+    for (; p < end && is_digit(*p); ++p, ++n_digits) {
+        if (mant < MAX_MANTISSA) mant = mant * 10 + (uint64_t)(*p - '0');
+        else exp10++;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && is_digit(*p); ++p, ++n_digits) {
+            if (mant < MAX_MANTISSA) {
+                mant = mant * 10 + (uint64_t)(*p - '0');
+                exp10--;
+            }
+        }
+    }
+    if (n_digits == 0) return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int eneg = 0, e = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            eneg = (*q == '-');
+            q++;
+        }
+        if (q < end && is_digit(*q)) {
+            for (; q < end && is_digit(*q); ++q) {
+                if (e < MAX_EXPONENT) e = e * 10 + (*q - '0');
+            }
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+
+    double v = scale_pow10((double)mant, exp10);
+    *out = (float)(neg ? -v : v);
+    return p;
+}
+
+/*
+ * parse one line into row r of the table. Returns the number of columns
+ * found, or -(column+1) for the first field that is not a number.
+ */
+static int parse_row(csv_table_t* t, int r, const char* p, const char* end)
+{
+    int c = 0;
+    while (1) {
+        while (p < end && is_space(*p)) p++;
+        float v;
+        const char* q = parse_number(p, end, &v);
+        if (!q) return -(c + 1);
+        if (c < t->n_cols) t->col[c][r] = v;
+        c++;
+
+        p = q;
+        while (p < end && is_space(*p)) p++;
+        if (p >= end) break;
+        if (*p != ',') return -c;
+        p++;
+    }
+    return c;
+}
+
+static int alloc_columns(csv_table_t* t, int cap)
+{
+    for (int c = 0; c < t->n_cols; ++c) {
+        size_t size = (size_t)cap * sizeof(float);
+        t->col[c] = t->arena ? arena_alloc(t->arena, size) : malloc(size);
+        if (!t->col[c]) return -1;
+    }
+    t->cap_rows = cap;
+    return 0;
+}
+
+
+int csv_load(csv_table_t* t, const char* file, int n_required, int n_cols, arena_t* arena)
+{
+    memset(t, 0, sizeof(*t));
+    if (n_cols < n_required || n_cols > CSV_MAX_COLS || n_required < 1) return -1;
+    t->n_cols = n_cols;
+    t->arena = arena;
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open %s\n", file);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    // read rather than mapped, a file being copied over in place would
+    // otherwise fault past its new end in the middle of parsing
+    char* data = NULL;
+    size_t len = 0;
+    if (st.st_size > 0) {
+        data = malloc(st.st_size);
+        if (!data) {
+            fprintf(stderr, "ERROR: out of memory loading %s\n", file);
+            close(fd);
+            return -1;
+        }
+        while (len < (size_t)st.st_size) {
+            ssize_t n = read(fd, data + len, st.st_size - len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            len += n;
+        }
+    }
+    close(fd);
+
+    // one row per line at most, count them so each column is allocated once
+    int cap = 1;
+    for (const char* q = data; q && (q = memchr(q, '\n', data + len - q)); ++q) cap++;
+    if (alloc_columns(t, cap)) {
+        fprintf(stderr, "ERROR: out of memory loading %s\n", file);
+        free(data);
+        csv_free(t);
+        return -1;
+    }
+
+    int ret = 0;
+    int line_no = 0;
+    int header_ok = 1;  // a header may appear before the first data row
+    const char* p = data;
+    const char* end = data + len;
+    while (p && p < end) {
+        const char* eol = memchr(p, '\n', end - p);
+        const char* next = eol ? eol + 1 : end;
+        if (!eol) eol = end;
+        if (eol > p && eol[-1] == '\r') eol--;
+        line_no++;
+
+        while (p < eol && is_space(*p)) p++;
+        if (p == eol || *p == '#') {
+            p = next;
+            continue;
+        }
+
+        float first;
+        if (header_ok && !parse_number(p, eol, &first)) {
+            header_ok = 0;
+            p = next;
+            continue;
+        }
+        header_ok = 0;
+
+        int r = t->n_rows;
+        int n = parse_row(t, r, p, eol);
+        if (n < 0) {
+            fprintf(stderr, "ERROR: %s:%d: column %d is not a number\n", file, line_no, -n);
+            ret = -1;
+            break;
+        }
+        if (n < n_required) {
+            fprintf(stderr, "ERROR: %s:%d: expected at least %d columns, found %d\n",
+                    file, line_no, n_required, n);
+            ret = -1;
+            break;
+        }
+        for (int c = n; c < t->n_cols; ++c) t->col[c][r] = NAN;
+        t->n_rows++;
+        p = next;
+    }
+
+    free(data);
+    if (ret) csv_free(t);
+    return ret;
+}
+
+
+float* csv_take_col(csv_table_t* t, int c)
+{
+    float* col = t->col[c];
+    t->col[c] = NULL;
+    return col;
+}
+
+
+void csv_free(csv_table_t* t)
+{
+    if (!t->arena) {
+        for (int c = 0; c < CSV_MAX_COLS; ++c) free(t->col[c]);
+    }
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,50 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+/**
+ * Numeric CSV loader shared by the path, tag map and compiler code.
+ *
+ * The file is read in one go and parsed in one pass straight into one float
+ * array per column. Rows are counted up front so each column is allocated
+ * once, and numbers are parsed by hand so the result does not depend on the
+ * process locale. Blank lines and lines starting with '#' are skipped, as
+ * is a header row before the first data row. Any other line that does not
+ * parse is reported with its line number and fails the load.
+ */
+
+#include "arena.h"
+
+#define CSV_MAX_COLS 8
+
+typedef struct csv_table_t {
+    int n_cols;                 // columns stored per row
+    int n_rows;
+    int cap_rows;               // allocated length of each column
+    float* col[CSV_MAX_COLS];   // col[c][row], NAN where an optional column was absent
+    arena_t* arena;             // owner of the columns, NULL for malloc
+} csv_table_t;
+
+
+/**
+ * @brief      load a numeric CSV file
+ *
+ * @param[out] t           table, must be zeroed or freed before reuse
+ * @param[in]  n_required  columns every row must have
+ * @param[in]  n_cols      columns stored, extra ones on a line are ignored
+ * @param[in]  arena       allocate the columns here, or NULL to malloc them
+ *
+ * @return     0 on success, -1 on failure with the reason printed
+ */
+int csv_load(csv_table_t* t, const char* file, int n_required, int n_cols, arena_t* arena);
+
+/**
+ * @brief      hand ownership of a column to the caller
+ *
+ *             The caller frees the returned array unless it came from an
+ *             arena, csv_free() skips it.
+ */
+float* csv_take_col(csv_table_t* t, int c);
+
+void csv_free(csv_table_t* t);
+
+#endif // CSV_READER_H
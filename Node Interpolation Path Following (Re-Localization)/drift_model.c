@@ -0,0 +1,85 @@
+#include <string.h>
+#include <math.h>
+
+#include "drift_model.h"
+
+#define DRIFT_MIN_GAP_S 1.0f    // corrections closer than this are not compared
+#define DRIFT_FORGET 0.9f       // weight left on the past after each comparison
+#define DRIFT_P0 1.0f           // initial covariance, rates start out unknown
+#define DRIFT_P_MAX 10.0f       // stop forgetting in directions the flight doesn't excite
+#define DRIFT_MIN_UPDATES 3     // comparisons before the rates are used
+#define DRIFT_MAX_PER_S 0.1f    // changes implying faster drift are relocalization jumps (m/s, rad/s)
+#define DRIFT_MAX_PER_M 0.1f    // same per meter travelled (m/m, rad/m)
+
+
+void drift_model_reset(drift_model_t* d)
+{
+    memset(d, 0, sizeof(*d));
+    for (int k = 0; k < 4; ++k) {
+        d->P[k][0][0] = DRIFT_P0;
+        d->P[k][1][1] = DRIFT_P0;
+    }
+}
+
+
+// one recursive least squares step for component k: delta ~ theta . (dt, dd)
+static void rls_update(drift_model_t* d, int k, float dt, float dd, float delta)
+{
+    float (*P)[2] = d->P[k];
+    float* th = d->theta[k];
+
+    float Px0 = P[0][0] * dt + P[0][1] * dd;
+    float Px1 = P[1][0] * dt + P[1][1] * dd;
+    float denom = DRIFT_FORGET + dt * Px0 + dd * Px1;
+    float g0 = Px0 / denom;
+    float g1 = Px1 / denom;
+
+    float err = delta - (th[0] * dt + th[1] * dd);
+    th[0] += g0 * err;
+    th[1] += g1 * err;
+
+    float forget = (P[0][0] + P[1][1] > DRIFT_P_MAX) ? 1.0f : DRIFT_FORGET;
+    float p00 = (P[0][0] - g0 * Px0) / forget;
+    float p01 = (P[0][1] - g0 * Px1) / forget;
+    float p11 = (P[1][1] - g1 * Px1) / forget;
+    P[0][0] = p00;
+    P[0][1] = P[1][0] = p01;
+    P[1][1] = p11;
+}
+
+
+void drift_model_update(drift_model_t* d, reloc_correction_t* c)
+{
+    if (!d->have_anchor) {
+        d->anchor = *c;
+        d->have_anchor = 1;
+    }
+
+    float dt = (c->timestamp_ns - d->anchor.timestamp_ns) * 1e-9f;
+    float dd = c->odometer_m - d->anchor.odometer_m;
+    if (dt >= DRIFT_MIN_GAP_S && dd >= 0.0f) {
+        float delta[4] = {
+            c->x - d->anchor.x,
+            c->y - d->anchor.y,
+            c->z - d->anchor.z,
+            atan2f(sinf(c->yaw - d->anchor.yaw), cosf(c->yaw - d->anchor.yaw))
+        };
+
+        // a change no plausible drift explains is a jump to a new fix, only re-anchor
+        int plausible = 1;
+        for (int k = 0; k < 4; ++k) {
+            if (fabsf(delta[k]) > DRIFT_MAX_PER_S * dt + DRIFT_MAX_PER_M * dd) plausible = 0;
+        }
+        if (plausible) {
+            for (int k = 0; k < 4; ++k) rls_update(d, k, dt, dd, delta[k]);
+            d->n_updates++;
+        }
+        d->anchor = *c;
+    }
+
+    for (int k = 0; k < 4; ++k) {
+        int use = d->n_updates >= DRIFT_MIN_UPDATES;
+        c->drift_per_s[k] = use ? d->theta[k][0] : 0.0f;
+        c->drift_per_m[k] = use ? d->theta[k][1] : 0.0f;
+    }
+}
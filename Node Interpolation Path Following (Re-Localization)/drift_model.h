@@ -0,0 +1,39 @@
+#ifndef DRIFT_MODEL_H
+#define DRIFT_MODEL_H
+
+#include "reloc.h"
+
+/**
+ * Learns how fast VIO drifts from the relocalization corrections.
+ *
+ * The change in the correction between two sightings is the drift VIO
+ * accumulated in between. It is modelled per component (x, y, z, yaw) as a
+ * rate per second plus a rate per meter travelled, fitted by recursive least
+ * squares with a forgetting factor so the model follows changes in lighting
+ * or texture over a flight. Each update is a fixed handful of flops.
+ *
+ * Corrections are only compared once they are DRIFT_MIN_GAP_S apart, so the
+ * frame to frame noise of a tag in continuous view is not mistaken for drift.
+ */
+
+typedef struct drift_model_t {
+    float theta[4][2];          // per component: drift per second, per meter
+    float P[4][2][2];           // and its covariance
+    reloc_correction_t anchor;  // correction the next change is measured from
+    int have_anchor;
+    int n_updates;
+} drift_model_t;
+
+
+// forget everything learned
+void drift_model_reset(drift_model_t* d);
+
+/**
+ * @brief      learn from a new correction and write the current rates into it
+ *
+ *             c->odometer_m must be set. The rates stay 0 until enough
+ *             sightings have been compared.
+ */
+void drift_model_update(drift_model_t* d, reloc_correction_t* c);
+
+#endif // DRIFT_MODEL_H
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "file_watch.h"
+
+#define POLL_MS     100     // how often the thread checks for stop and trigger
+#define SETTLE_MS   200     // quiet time after the last event before calling back
+
+static int running = 0;
+static pthread_t thread_id;
+static int fd = -1;
+static const char* const* watch_names;
+static file_watch_cb* watch_cb;
+static volatile int triggered = 0;
+
+
+static int is_watched(const char* name)
+{
+    for (int i = 0; watch_names[i]; ++i) {
+        if (strcmp(name, watch_names[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// drain pending events, return 1 if any touched a watched file
+static int read_events(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int hit = 0;
+
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char* ptr = buf; ptr < buf + len; ) {
+            const struct inotify_event* ev = (const struct inotify_event*)ptr;
+            if (ev->len && is_watched(ev->name)) hit = 1;
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return hit;
+}
+
+static void* thread_func(__attribute__((unused)) void* arg)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int pending = 0;
+
+    while (running) {
+        int ret = poll(&pfd, 1, pending ? SETTLE_MS : POLL_MS);
+        if (ret > 0 && read_events()) {
+            // a copy shows up as several events, wait until it has gone quiet
+            pending = 1;
+            continue;
+        }
+        if (triggered) {
+            triggered = 0;
+            pending = 1;
+        }
+        if (pending && ret == 0) {
+            pending = 0;
+            watch_cb();
+        }
+    }
+    return NULL;
+}
+
+int file_watch_start(const char* dir, const char* const* names, file_watch_cb* cb)
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        perror("Could not start inotify");
+        return -1;
+    }
+    // watch the directory, files copied with a rename get a new inode
+    if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "ERROR: could not watch %s\n", dir);
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    watch_names = names;
+    watch_cb = cb;
+    triggered = 0;
+    running = 1;
+    if (pthread_create(&thread_id, NULL, thread_func, NULL)) {
+        running = 0;
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void file_watch_trigger(void)
+{
+    triggered = 1;
+}
+
+void file_watch_stop(void)
+{
+    if (!running) return;
+    running = 0;
+    pthread_join(thread_id, NULL);
+    close(fd);
+    fd = -1;
+}
@@ -0,0 +1,33 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+/**
+ * Background watcher for files being replaced in a directory.
+ *
+ * One thread waits on inotify for any of the named files in dir to be
+ * closed after writing or renamed into place, lets the burst of events
+ * from a copy settle, then calls cb from that thread. file_watch_trigger()
+ * asks for the same callback from anywhere else, e.g. a pipe command, so
+ * every reload runs on the one watcher thread and never in parallel.
+ */
+
+typedef void file_watch_cb(void);
+
+/**
+ * @brief      start watching
+ *
+ * @param[in]  dir      directory holding the files
+ * @param[in]  names    NULL terminated list of file names inside dir
+ * @param[in]  cb       called on the watcher thread after a change
+ *
+ * @return     0 on success, -1 on failure
+ */
+int file_watch_start(const char* dir, const char* const* names, file_watch_cb* cb);
+
+// request a callback as if a watched file had changed, never blocks
+void file_watch_trigger(void);
+
+// stop the watcher thread and wait for a callback in progress to finish
+void file_watch_stop(void);
+
+#endif // FILE_WATCH_H
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "frame_filter.h"
+
+// kalman tuning, standard deviations
+#define DRIFT_STD_M 0.05f       // VIO position drift with good quality (m/sqrt(s))
+#define DRIFT_STD_YAW 0.01f     // VIO yaw drift with good quality (rad/sqrt(s))
+#define MEAS_STD_M 0.05f        // one tag frame's position error (m)
+#define MEAS_STD_YAW 0.03f      // one tag frame's yaw error (rad)
+#define MIN_QUALITY 0.1f        // drift grows by up to 1/MIN_QUALITY as quality drops
+
+enum { EST_X, EST_Y, EST_Z, EST_YAW };
+
+
+static float wrap_pi(float a)
+{
+    return atan2f(sinf(a), cosf(a));
+}
+
+static void set_yaw(reloc_correction_t* c, float yaw)
+{
+    c->yaw = yaw;
+    c->cos_yaw = cosf(yaw);
+    c->sin_yaw = sinf(yaw);
+}
+
+
+int frame_filter_init(frame_filter_t* f, frame_filter_mode_t mode, int len)
+{
+    memset(f, 0, sizeof(*f));
+    f->mode = mode;
+    f->len = (len < 1) ? 1 : len;
+    if (mode == FRAME_FILTER_AVERAGE) {
+        f->ring = malloc(f->len * sizeof(reloc_correction_t));
+        if (!f->ring) return -1;
+    }
+    return 0;
+}
+
+
+void frame_filter_reset(frame_filter_t* f)
+{
+    f->n = 0;
+    f->head = 0;
+    f->sum_x = f->sum_y = f->sum_z = f->sum_cos = f->sum_sin = 0.0;
+    f->last_ns = 0;
+}
+
+
+static void average_add(frame_filter_t* f, const reloc_correction_t* in, reloc_correction_t* out)
+{
+    if (f->n == f->len) {
+        const reloc_correction_t* old = &f->ring[f->head];
+        f->sum_x -= (double)old->x;
+        f->sum_y -= (double)old->y;
+        f->sum_z -= (double)old->z;
+        f->sum_cos -= (double)old->cos_yaw;
+        f->sum_sin -= (double)old->sin_yaw;
+    } else {
+        f->n++;
+    }
+    f->ring[f->head] = *in;
+    f->head = (f->head + 1) % f->len;
+    f->sum_x += (double)in->x;
+    f->sum_y += (double)in->y;
+    f->sum_z += (double)in->z;
+    f->sum_cos += (double)in->cos_yaw;
+    f->sum_sin += (double)in->sin_yaw;
+
+    *out = *in;
+    out->x = (float)(f->sum_x / f->n);
+    out->y = (float)(f->sum_y / f->n);
+    out->z = (float)(f->sum_z / f->n);
+    set_yaw(out, (float)atan2(f->sum_sin, f->sum_cos));
+}
+
+
+/*
+ * Four independent scalar filters. Poor VIO quality inflates the drift
+ * between updates so the next tag frame is trusted more.
+ */
+static void kalman_add(frame_filter_t* f, const reloc_correction_t* in, int vio_quality,
+                       reloc_correction_t* out)
+{
+    float n_tags = (in->n_tags > 0) ? (float)in->n_tags : 1.0f;
+    float meas[4] = { in->x, in->y, in->z, in->yaw };
+    float r[4];
+    r[EST_X] = r[EST_Y] = r[EST_Z] = MEAS_STD_M * MEAS_STD_M / n_tags;
+    r[EST_YAW] = MEAS_STD_YAW * MEAS_STD_YAW / n_tags;
+
+    if (f->last_ns == 0) {
+        memcpy(f->est, meas, sizeof(meas));
+        memcpy(f->var, r, sizeof(r));
+    } else {
+        float quality = 1.0f;
+        if (vio_quality < 0) quality = MIN_QUALITY;
+        else if (vio_quality > 0) quality = vio_quality / 100.0f;
+        if (quality < MIN_QUALITY) quality = MIN_QUALITY;
+        if (quality > 1.0f) quality = 1.0f;
+
+        float dt = (in->timestamp_ns - f->last_ns) * 1e-9f;
+        if (dt < 0.0f) dt = 0.0f;
+        float q_pos = DRIFT_STD_M * DRIFT_STD_M * dt / (quality * quality);
+        float q_yaw = DRIFT_STD_YAW * DRIFT_STD_YAW * dt / (quality * quality);
+
+        for (int k = 0; k < 4; ++k) {
+            float var = f->var[k] + ((k == EST_YAW) ? q_yaw : q_pos);
+            float innov = meas[k] - f->est[k];
+            if (k == EST_YAW) innov = wrap_pi(innov);
+            float gain = var / (var + r[k]);
+            f->est[k] += gain * innov;
+            f->var[k] = (1.0f - gain) * var;
+        }
+        f->est[EST_YAW] = wrap_pi(f->est[EST_YAW]);
+    }
+    f->last_ns = in->timestamp_ns;
+
+    *out = *in;
+    out->x = f->est[EST_X];
+    out->y = f->est[EST_Y];
+    out->z = f->est[EST_Z];
+    set_yaw(out, f->est[EST_YAW]);
+}
+
+
+void frame_filter_add(frame_filter_t* f, const reloc_correction_t* in, int vio_quality,
+                      reloc_correction_t* out)
+{
+    if (f->mode == FRAME_FILTER_KALMAN) kalman_add(f, in, vio_quality, out);
+    else average_add(f, in, out);
+}
+
+
+void frame_filter_free(frame_filter_t* f)
+{
+    free(f->ring);
+    memset(f, 0, sizeof(*f));
+}
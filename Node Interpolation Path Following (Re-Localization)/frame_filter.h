@@ -0,0 +1,63 @@
+#ifndef FRAME_FILTER_H
+#define FRAME_FILTER_H
+
+#include "reloc.h"
+
+/**
+ * Smoothing of tag-derived local to map corrections, constant cost per
+ * update whatever the window.
+ *
+ * Average mode is a moving average over the last len corrections kept as
+ * running sums: each update adds the newest and subtracts the one leaving
+ * the ring. Yaw is averaged on the unit circle through sums of cos and sin,
+ * so corrections either side of +-180deg average correctly.
+ *
+ * Kalman mode treats yaw and each axis of the translation as a random walk,
+ * drifting faster when VIO reports poor quality, and measured by every
+ * fused tag frame. It follows a real drift quickly when VIO degrades and
+ * smooths hard when it is healthy, again at a fixed cost per update.
+ */
+
+typedef enum frame_filter_mode_t {
+    FRAME_FILTER_AVERAGE,
+    FRAME_FILTER_KALMAN
+} frame_filter_mode_t;
+
+typedef struct frame_filter_t {
+    frame_filter_mode_t mode;
+    int len;                    // average window
+    int n;                      // corrections in the window
+    int head;                   // ring slot the next correction goes in
+    reloc_correction_t* ring;
+    double sum_x, sum_y, sum_z, sum_cos, sum_sin;
+
+    float est[4];               // kalman estimate: x, y, z, yaw
+    float var[4];               // and its variance
+    int64_t last_ns;            // time of the last kalman update, 0 before the first
+} frame_filter_t;
+
+
+/**
+ * @brief      set up a filter, the ring is allocated here once
+ *
+ * @param[in]  len   moving average window, ignored in kalman mode
+ *
+ * @return     0 on success, -1 on failure
+ */
+int frame_filter_init(frame_filter_t* f, frame_filter_mode_t mode, int len);
+
+/**
+ * @brief      add a correction and get the filtered one
+ *
+ * @param[in]  vio_quality  VIO quality 1-100, 0 if unknown, -1 if VIO failed
+ * @param[out] out          filtered correction, may alias in
+ */
+void frame_filter_add(frame_filter_t* f, const reloc_correction_t* in, int vio_quality,
+                      reloc_correction_t* out);
+
+// forget all history
+void frame_filter_reset(frame_filter_t* f);
+
+void frame_filter_free(frame_filter_t* f);
+
+#endif // FRAME_FILTER_H
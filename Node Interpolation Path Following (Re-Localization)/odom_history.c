@@ -0,0 +1,81 @@
+#include <math.h>
+
+#include "odom_history.h"
+
+/*
+ * Sequence lock around the ring, like the published relocalization. The
+ * writer makes seq odd while it writes, a reader retries if seq was odd or
+ * changed under it.
+ */
+static unsigned int seq = 0;
+static odom_sample_t ring[ODOM_HISTORY_LEN];
+static int head = 0;        // next slot written
+static int count = 0;
+
+// k-th oldest sample
+static const odom_sample_t* sample(int k)
+{
+    return &ring[(head - count + k + ODOM_HISTORY_LEN) % ODOM_HISTORY_LEN];
+}
+
+
+float odom_history_push(odom_sample_t* s)
+{
+    s->odometer_m = 0.0f;
+    if (count > 0) {
+        const odom_sample_t* last = sample(count - 1);
+        float dx = s->x - last->x;
+        float dy = s->y - last->y;
+        float dz = s->z - last->z;
+        s->odometer_m = last->odometer_m + sqrtf(dx*dx + dy*dy + dz*dz);
+    }
+
+    __atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq visible before the sample, as in reloc.c
+    ring[head] = *s;
+    head = (head + 1) % ODOM_HISTORY_LEN;
+    if (count < ODOM_HISTORY_LEN) count++;
+    __atomic_add_fetch(&seq, 1, __ATOMIC_RELEASE);
+    return s->odometer_m;
+}
+
+
+int odom_history_at(int64_t timestamp_ns, odom_sample_t* out)
+{
+    odom_sample_t a = {0}, b = {0};
+    int n;
+    unsigned int before, after;
+    do {
+        before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        n = count;
+        if (n > 0) {
+            // samples up to timestamp_ns, the one after it is the upper bracket
+            int lo = 0, hi = n;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (sample(mid)->timestamp_ns <= timestamp_ns) lo = mid + 1;
+                else hi = mid;
+            }
+            a = *sample(lo > 0 ? lo - 1 : 0);
+            b = *sample(lo < n ? lo : n - 1);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+
+    if (n == 0) return -1;
+
+    float f = 0.0f;
+    if (b.timestamp_ns > a.timestamp_ns) {
+        f = (float)(timestamp_ns - a.timestamp_ns) / (float)(b.timestamp_ns - a.timestamp_ns);
+        if (f < 0.0f) f = 0.0f;
+        if (f > 1.0f) f = 1.0f;
+    }
+    out->timestamp_ns = timestamp_ns;
+    out->x = a.x + f * (b.x - a.x);
+    out->y = a.y + f * (b.y - a.y);
+    out->z = a.z + f * (b.z - a.z);
+    out->odometer_m = a.odometer_m + f * (b.odometer_m - a.odometer_m);
+    out->quality = a.quality < b.quality ? a.quality : b.quality;
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef ODOM_HISTORY_H
+#define ODOM_HISTORY_H
+
+#include <stdint.h>
+
+/**
+ * Recent odometry, so a tag detection is paired with where the vehicle was
+ * when its camera frame was exposed rather than when the detection arrived,
+ * tens of milliseconds later.
+ *
+ * autopilot_monitor only keeps the latest odometry. The sender pushes it
+ * every tick, stamped in the monotonic clock tag detections are stamped in,
+ * along with the distance travelled so far. Lookups interpolate between the
+ * two samples either side of the requested time.
+ *
+ * There is one writer. Readers on other threads copy what they need under a
+ * sequence lock, so the writer never waits on them.
+ */
+
+// samples kept, one per tick: 2s at the highest offboard_rate_hz of 250, 16KB.
+// Detections older than the history are clamped to its oldest sample.
+#define ODOM_HISTORY_LEN 512
+
+typedef struct odom_sample_t {
+    int64_t timestamp_ns;
+    float x, y, z;          // local position
+    float odometer_m;       // distance travelled in local frame up to here
+    int quality;            // VIO quality 1-100, 0 if unknown, -1 if VIO failed
+} odom_sample_t;
+
+
+/**
+ * @brief      record the latest odometry, only ever from one thread
+ *
+ *             The odometer is filled in from the distance to the previous
+ *             sample.
+ *
+ * @return     distance travelled up to s
+ */
+float odom_history_push(odom_sample_t* s);
+
+/**
+ * @brief      odometry at a past time, interpolated between samples
+ *
+ *             Times outside the history are clamped to its oldest or newest
+ *             sample. The quality is the worse of the two samples.
+ *
+ * @return     0 on success, -1 if nothing has been recorded yet
+ */
+int odom_history_at(int64_t timestamp_ns, odom_sample_t* out);
+
+#endif // ODOM_HISTORY_H
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "offboard_executor.h"
+#include "timing_hist.h"
+#include "rt_thread.h"
+#include "config_file.h"
+#include "autopilot_monitor.h"
+#include "macros.h"
+#include "misc.h"
+
+#define NS_PER_S 1000000000LL
+
+
+// in order, a drop out of offboard sends everything from EXEC_WARMUP on back home
+enum { EXEC_IDLE, EXEC_HANDOFF, EXEC_PRESTREAM, EXEC_HOME, EXEC_WARMUP, EXEC_START, EXEC_PATH };
+
+static int running = 0;
+static pthread_t thread_id;
+static int rate_hz;                 // offboard_rate_hz when the thread started
+static float tick_dt;               // time since the previous tick was due
+
+// held for a whole tick, so attach and detach happen between ticks
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const offboard_executor_mode_t* mode = NULL;
+static int state = EXEC_IDLE;
+static int ticks = 0;               // ticks spent in state
+static int join = 0;                // the attached mode took over in flight
+static int have_setpoint = 0;       // setpoint was sent and the stream hasn't stopped since
+static mavlink_set_position_target_local_ned_t setpoint;
+
+// loop timing, written by the executor thread only
+static timing_hist_t wake_hist;     // how far past its deadline each tick woke
+static timing_hist_t tick_hist;     // time spent in each tick
+static uint32_t n_overruns = 0;     // ticks that ran into the next tick's period
+static uint32_t n_skipped = 0;      // deadlines dropped to catch up
+static int reset_requested = 0;
+
+
+static int ticks_for(float seconds)
+{
+    return (int)(seconds * rate_hz + 0.5f);
+}
+
+static void set_state(int s)
+{
+    state = s;
+    ticks = 0;
+    if (s == EXEC_IDLE) have_setpoint = 0;
+}
+
+// keep sending the position of the last setpoint, without its feed-forward
+static void hold_setpoint(void)
+{
+    setpoint.vx = setpoint.vy = setpoint.vz = 0.0f;
+    setpoint.afx = setpoint.afy = setpoint.afz = 0.0f;
+    setpoint.yaw_rate = 0.0f;
+    setpoint.type_mask = POSITION_TARGET_TYPEMASK_VX_IGNORE |
+                         POSITION_TARGET_TYPEMASK_VY_IGNORE |
+                         POSITION_TARGET_TYPEMASK_VZ_IGNORE |
+                         POSITION_TARGET_TYPEMASK_AX_IGNORE |
+                         POSITION_TARGET_TYPEMASK_AY_IGNORE |
+                         POSITION_TARGET_TYPEMASK_AZ_IGNORE |
+                         POSITION_TARGET_TYPEMASK_YAW_RATE_IGNORE;
+    set_state(EXEC_HANDOFF);
+}
+
+// hold where the vehicle is, for when no setpoint has been streamed to hold
+static void hold_position(void)
+{
+    mavlink_odometry_t odom = autopilot_monitor_get_odometry();
+    memset(&setpoint, 0, sizeof(setpoint));
+    setpoint.coordinate_frame = MAV_FRAME_LOCAL_NED;
+    setpoint.target_component = AUTOPILOT_COMPID;
+    setpoint.x = odom.x;
+    setpoint.y = odom.y;
+    setpoint.z = odom.z;
+    hold_setpoint();
+    setpoint.type_mask |= POSITION_TARGET_TYPEMASK_YAW_IGNORE;
+}
+
+// one tick of the state machine, returns 1 if setpoint is to be sent
+static int tick(void)
+{
+    int offboard = autopilot_monitor_is_armed_and_in_offboard_mode();
+
+    if (!mode) {
+        if (state == EXEC_HANDOFF && offboard && ticks++ < ticks_for(EXEC_HANDOFF_S)) return 1;
+        set_state(EXEC_IDLE);
+        return 0;
+    }
+
+    // return to home position if px4 falls out of offboard mode or disarms
+    if (!offboard && state >= EXEC_WARMUP) {
+        if (state == EXEC_PATH && mode->leave) mode->leave();
+        set_state(EXEC_HOME);
+    }
+
+    switch (state) {
+    case EXEC_HANDOFF:
+        // holding in flight because the mode couldn't start, try it again now and then
+        if (!offboard) {
+            set_state(EXEC_HOME);
+            return mode->home(&setpoint) == 0;
+        }
+        if (++ticks >= ticks_for(EXEC_HANDOFF_S)) set_state(EXEC_START);
+        return 1;
+
+    case EXEC_PRESTREAM:
+        if (++ticks >= ticks_for(EXEC_PRESTREAM_S)) set_state(EXEC_HOME);
+        return mode->home(&setpoint) == 0;
+
+    case EXEC_HOME:
+        if (!offboard) return mode->home(&setpoint) == 0;
+        set_state(EXEC_WARMUP);
+        /* fall through */
+
+    case EXEC_WARMUP:
+        if (ticks++ < ticks_for(EXEC_WARMUP_S)) return mode->home(&setpoint) == 0;
+        set_state(EXEC_START);
+        /* fall through */
+
+    case EXEC_START:
+        if (mode->start(join)) {
+            // PX4 fails over if the stream stops in offboard, hold instead of going home
+            if (offboard) {
+                if (have_setpoint) hold_setpoint();
+                else hold_position();
+                return 1;
+            }
+            set_state(EXEC_HOME);
+            return 0;
+        }
+        join = 0;
+        set_state(EXEC_PATH);
+        /* fall through */
+
+    case EXEC_PATH:
+        return mode->next(&setpoint, tick_dt) == 0;
+    }
+    return 0;
+}
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t t_ns)
+{
+    struct timespec ts = { .tv_sec = t_ns / NS_PER_S, .tv_nsec = t_ns % NS_PER_S };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+
+/*
+ * Ticks are due on a fixed grid of absolute deadlines, so time spent in a
+ * tick never delays the ones after it and the rate doesn't drift. A tick
+ * that runs past the next deadline is followed straight away by the next
+ * one. Deadlines a whole period or more in the past are dropped rather than
+ * sent in a burst, old setpoints are no use to PX4.
+ */
+static void* thread_func(__attribute__((unused)) void* arg)
+{
+    rt_thread_apply("offboard");
+    const int64_t period_ns = NS_PER_S / rate_hz;
+    int64_t deadline = now_ns();
+    int64_t last_deadline = deadline - period_ns;
+
+    while (running) {
+        sleep_until(deadline);
+        int64_t woke = now_ns();
+        if (__atomic_exchange_n(&reset_requested, 0, __ATOMIC_RELAXED)) {
+            timing_hist_reset(&wake_hist);
+            timing_hist_reset(&tick_hist);
+            __atomic_store_n(&n_overruns, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&n_skipped, 0, __ATOMIC_RELAXED);
+        }
+
+        tick_dt = (float)(deadline - last_deadline) * 1e-9f;
+        last_deadline = deadline;
+
+        pthread_mutex_lock(&lock);
+        if (tick()) {
+            mavlink_io_send_fixed_setpoint(autopilot_monitor_get_sysid(), VOXL_COMPID, setpoint);
+            have_setpoint = 1;
+        }
+        pthread_mutex_unlock(&lock);
+
+        int64_t done = now_ns();
+        timing_hist_record(&wake_hist, woke - deadline);
+        timing_hist_record(&tick_hist, done - woke);
+
+        deadline += period_ns;
+        if (done > deadline) {
+            __atomic_store_n(&n_overruns, n_overruns + 1, __ATOMIC_RELAXED);
+            int64_t behind = (done - deadline) / period_ns;
+            if (behind > 0) {
+                deadline += behind * period_ns;
+                __atomic_store_n(&n_skipped, n_skipped + (uint32_t)behind, __ATOMIC_RELAXED);
+                fprintf(stderr, "WARNING offboard executor fell behind, skipped %d ticks\n", (int)behind);
+            }
+        }
+    }
+
+    printf("exiting offboard executor thread\n");
+    return NULL;
+}
+
+
+int offboard_executor_start(void)
+{
+    if (running) return 0;
+    running = 1;
+    rate_hz = offboard_rate_hz;
+    if (pipe_pthread_create(&thread_id, thread_func, NULL, OFFBOARD_THREAD_PRIORITY)) {
+        fprintf(stderr, "ERROR: failed to start offboard executor thread\n");
+        running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+
+void offboard_executor_stop(void)
+{
+    if (!running) return;
+    running = 0;
+    pthread_join(thread_id, NULL);
+
+    pthread_mutex_lock(&lock);
+    mode = NULL;
+    set_state(EXEC_IDLE);
+    pthread_mutex_unlock(&lock);
+}
+
+
+void offboard_executor_attach(const offboard_executor_mode_t* m)
+{
+    pthread_mutex_lock(&lock);
+    if (mode && state == EXEC_PATH && mode->leave) mode->leave();
+    mode = m;
+
+    // taking over in flight, the stream can't pause for the pre-stream and warm-up
+    join = autopilot_monitor_is_armed_and_in_offboard_mode();
+    if (join) printf("offboard %s taking over in flight\n", m->name);
+    set_state(join ? EXEC_START : EXEC_PRESTREAM);
+    pthread_mutex_unlock(&lock);
+}
+
+
+void offboard_executor_detach(const offboard_executor_mode_t* m)
+{
+    pthread_mutex_lock(&lock);
+    if (mode == m) {
+        int flying = state >= EXEC_WARMUP;
+        if (state == EXEC_PATH && mode->leave) mode->leave();
+        mode = NULL;
+        if (flying && autopilot_monitor_is_armed_and_in_offboard_mode()) hold_setpoint();
+        else set_state(EXEC_IDLE);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+void offboard_executor_hold(void)
+{
+    pthread_mutex_lock(&lock);
+    if (!mode && state == EXEC_IDLE && autopilot_monitor_is_armed_and_in_offboard_mode()) {
+        hold_position();
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+void offboard_executor_release(void)
+{
+    pthread_mutex_lock(&lock);
+    if (!mode) set_state(EXEC_IDLE);
+    pthread_mutex_unlock(&lock);
+}
+
+
+void offboard_executor_print_timing(void)
+{
+    printf("offboard executor at %dHz, %u overruns, %u ticks skipped\n", rate_hz,
+           __atomic_load_n(&n_overruns, __ATOMIC_RELAXED), __atomic_load_n(&n_skipped, __ATOMIC_RELAXED));
+    timing_hist_print(&wake_hist, "wake latency");
+    timing_hist_print(&tick_hist, "tick duration");
+}
+
+
+void offboard_executor_reset_timing(void)
+{
+    __atomic_store_n(&reset_requested, 1, __ATOMIC_RELAXED);
+}
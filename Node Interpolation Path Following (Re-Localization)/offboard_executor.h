@@ -0,0 +1,88 @@
+#ifndef OFFBOARD_EXECUTOR_H
+#define OFFBOARD_EXECUTOR_H
+
+#include "mavlink_io.h"
+
+/**
+ * One thread streaming offboard setpoints for whichever mode is attached.
+ *
+ * The executor owns the loop timing, the arm and offboard state machine every
+ * mode used to carry a copy of, and the one setpoint sent each tick. A mode
+ * only fills that setpoint in, from callbacks run on the executor thread:
+ *
+ *   home   before and between flights. Streamed for EXEC_PRESTREAM_S
+ *          first, then until PX4 is armed in offboard and EXEC_WARMUP_S
+ *          after that so the vehicle settles there.
+ *   start  once as the path begins, join is set when the mode was attached
+ *          in flight and should pick its path up where the vehicle is.
+ *          Return -1 to go back to home. In offboard the last setpoint,
+ *          or the current position if none was streamed, is held instead
+ *          and start is retried every EXEC_HANDOFF_S.
+ *   next   every tick on the path, dt seconds after the previous tick was
+ *          due. Setpoints are meant to be evaluated at that exact time, so
+ *          the rate can change without touching how paths are stored.
+ *   leave  PX4 left offboard or disarmed, or the mode is detached, while on
+ *          the path. May be NULL.
+ *
+ * home and next return 0 to send the setpoint, -1 to send nothing that tick.
+ *
+ * A mode attached in flight takes over at the next tick with no pre-stream
+ * or warm-up. A mode detached in flight leaves its last setpoint held for
+ * EXEC_HANDOFF_S so the next one can take over without PX4 seeing a gap.
+ *
+ * Ticks run at offboard_rate_hz from the config file, scheduled on absolute
+ * deadlines. How late each tick wakes and how long it takes are kept in
+ * histograms, along with how often a tick overran into the next one, see
+ * offboard_executor_print_timing().
+ */
+
+#define EXEC_PRESTREAM_S 3.3f       // home streamed before anything else
+#define EXEC_WARMUP_S 2.0f          // home held after entering offboard
+#define EXEC_HANDOFF_S 1.0f         // longest a detached mode's setpoint is held, and the start retry period
+
+typedef struct offboard_executor_mode_t {
+    const char* name;
+    int  (*home)(mavlink_set_position_target_local_ned_t* sp);
+    int  (*start)(int join);
+    int  (*next)(mavlink_set_position_target_local_ned_t* sp, float dt);
+    void (*leave)(void);
+} offboard_executor_mode_t;
+
+
+// start and stop the executor thread, nothing is sent while no mode is attached
+int offboard_executor_start(void);
+void offboard_executor_stop(void);
+
+/**
+ * @brief      make m the mode streaming setpoints
+ *
+ *             Replaces any attached mode. Takes effect between two ticks.
+ */
+void offboard_executor_attach(const offboard_executor_mode_t* m);
+
+/**
+ * @brief      stop streaming for m, does nothing if m isn't attached
+ *
+ *             No callback of m runs once this returns.
+ */
+void offboard_executor_detach(const offboard_executor_mode_t* m);
+
+/**
+ * @brief      hold the current position while no mode is attached
+ *
+ *             Bridges a mode running its own thread handing over to one on
+ *             the executor, for up to EXEC_HANDOFF_S. Does nothing outside
+ *             offboard or when something is already streaming.
+ */
+void offboard_executor_hold(void);
+
+// drop a held setpoint so a mode on its own thread can stream alone
+void offboard_executor_release(void);
+
+// print wake-up latency and tick duration percentiles and the overrun count
+void offboard_executor_print_timing(void);
+
+// start the timing statistics over from the next tick
+void offboard_executor_reset_timing(void);
+
+#endif // OFFBOARD_EXECUTOR_H
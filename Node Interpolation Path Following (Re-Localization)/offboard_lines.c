@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <math.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "config_file.h"
 #include "mavlink_io.h"
@@ -11,131 +13,636 @@
 #include "macros.h"
 #include "misc.h"
 #include "offboard_lines.h"
-
-#define RATE 30
-#define STEPS 25000
-#define MAX_LINE 256
+#include "path_segments.h"
+#include "path_profile.h"
+#include "path_index.h"
+#include "path_binary.h"
+#include "path_spline.h"
+#include "file_watch.h"
+#include "csv_reader.h"
+#include "arena.h"
+#include "tag_map.h"
+#include "tag_visibility.h"
+#include "reloc.h"
+#include "tag_learn.h"
+#include "odom_history.h"
+#include "offboard_executor.h"
+
+#define SAMPLE_RATE_HZ 30.0f  // curves are sampled for this rate, faster setpoints interpolate between samples
 #define CSV_PATH "/data/path_points.csv" //Change to .CSV location
+#define BIN_PATH "/data/path_points.bin" // from path_compiler, used instead of the CSV when present
+#define TAG_MAP_PATH "/data/tag_map.csv"
+#define LEARNED_TAGS_PATH "/data/tag_map_learned.bin" // unsurveyed tags learned in flight
+#define MISSION_DIR "/data"     // watched for new mission files
+#define CONTROL_PIPE_NAME "vvhub_offboard_lines"
+#define INDEX_CELL_M 1.0f       // spatial index cell size
+#define CARROT_SEARCH_M 3.0f    // max distance from the path to still track progress
+#define CARROT_BEHIND_M 0.5f    // how far behind current progress a match may be
+#define CARROT_AHEAD_M 5.0f     // how far ahead of current progress a match may be
+#define RESUME_SEARCH_M 20.0f   // max distance to the path when resuming after a drop-out
+#define RESUME_RAMP_S 2.0f      // time to ease back up to the planned pace after resuming
+#define STOP_REACH_M 0.2f       // carrot mode starts a relocalization stop this close to it
+#define STOP_CONFIRMATIONS 3    // tag frames confirming the stop's tag before moving on
+#define STOP_TIMEOUT_S 8.0f     // longest a relocalization stop may last
+#define STOP_YAW_RATE 0.8f      // turn rate toward the tag and back (rad/s)
 
 static int running = 0;
-static pthread_t thread_id;
 static int en_debug = 0;
 
-static mavlink_set_position_target_local_ned_t path[STEPS];
+static int control_ch = -1;
+
+/*
+ * Everything loaded from the mission files. A new mission is built off the
+ * sender thread and swapped in whole, so the sender never sees a half
+ * loaded path and never waits for a load. Path and tag storage come from
+ * the mission's arena and are sized by what was loaded.
+ */
+typedef struct mission_t {
+    arena_t arena;
+    path_t path;
+    path_limits_t limits;
+    path_index_t index;
+    tag_map_t tags;
+    tag_visibility_t visible;   // tags expected per segment, seg_start NULL if not predicted
+    float cam_heading;          // camera heading relative to the body, NAN if looking straight down or up
+    unsigned int generation;    // tells missions apart even if an address is reused
+} mission_t;
+
+// threads that read the active mission, each announces the one it is reading
+enum { READER_SENDER, READER_RELOC, N_READERS };
+
+static mission_t* active_mission = NULL;   // latest complete mission
+static mission_t* mission_in_use[N_READERS]; // mission each reader is using right now
+static unsigned int mission_count = 0;
+
+// sender thread state
+static unsigned int mission_generation = 0; // generation of the mission the state below refers to
+static int in_flight = 0;          // sending path setpoints
+static int seg_hint = -1;
+static float progress_s = 0.0f;    // arc length of mission progress
+static float path_time = 0.0f;     // profile time of the last open loop setpoint
+static float ramp_time = 0.0f;     // time since (re)starting the open loop replay
+static int mission_started = 0;
+static float origin_x, origin_y, origin_z; // home when the mission first started
 static mavlink_set_position_target_local_ned_t home_position;
+// relocalization stop state, see stop_tick()
+static int next_action = 0;        // first action not performed yet
+static int stopped = 0;            // holding at an action
+static int stop_phase;             // STOP_TURN, STOP_WAIT or STOP_RETURN
+static float stop_time;            // time since the stop began
+static float stop_yaw;             // yaw setpoint, path frame
+static float stop_target_yaw;      // yaw pointing the camera at the tag
+enum { STOP_TURN, STOP_WAIT, STOP_RETURN };
+static int reloc_active = 0;
+static int save_learned_requested = 0; // landed, the watcher thread saves the learned tags
+static reloc_correction_t correction = { .cos_yaw = 1.0f }; // local to map, read once per tick
+static float odometer_m = 0.0f;    // distance travelled in local frame, for drift per meter
+// mission generation in the high half and segment being flown in the low half, -1 on the ground
+static uint64_t flown_seg = (uint32_t)-1;
+
+static int load_apriltag_map(mission_t* m, const char* path)
+{
+    if (tag_map_load_csv(&m->tags, path, &m->arena)) return -1;
+    printf("Loaded %d tag poses\n", m->tags.n_tags);
+    return 0;
+}
 
-typedef struct {
-    float coorx[STEPS];
-    float coory[STEPS];
-    float coorz[STEPS];
-    int nb_pts;
-} CoordinateList;
-
-typedef struct {
-    int id;
-    float x, y, z;
-    float yaw_deg;
-} apriltag_pose_t;
-
-apriltag_pose_t tag_map[50];
-int tag_map_count = 0;
-
-int load_apriltag_map(const char* path) {
-    FILE* fp = fopen(path, "r");
-    if (!fp) {
-        printf("ERROR: could not open %s\n", path);
-        return -1;
+// index tag poses compiled into the mission, used instead of tag_map.csv
+static int load_compiled_tags(mission_t* m, const path_bin_tag_t* tags, int n_tags)
+{
+    if (tag_map_init(&m->tags, n_tags, &m->arena)) return -1;
+    for (int i = 0; i < n_tags; ++i) {
+        apriltag_pose_t pose = {
+            .id = tags[i].id,
+            .x = tags[i].x,
+            .y = tags[i].y,
+            .z = tags[i].z,
+            .yaw_deg = tags[i].yaw_deg
+        };
+        if (tag_map_add(&m->tags, &pose)) return -1;
     }
+    printf("Loaded %d tag poses from compiled mission\n", m->tags.n_tags);
+    return 0;
+}
 
-    tag_map_count = 0;
-    char line[128];
-    while (fgets(line, sizeof(line), fp) && tag_map_count < 50) {
-        if (line[0] == '#' || strlen(line) < 3) continue;
-        if (sscanf(line, "%d,%f,%f,%f,%f",
-            &tag_map[tag_map_count].id,
-            &tag_map[tag_map_count].x,
-            &tag_map[tag_map_count].y,
-            &tag_map[tag_map_count].z,
-            &tag_map[tag_map_count].yaw_deg) == 5) {
-            tag_map_count++;
-        }
+// camera tags are detected with, as mounted on the body
+static int load_tag_camera(tag_camera_t* cam)
+{
+    rc_matrix_t R = RC_MATRIX_INITIALIZER;
+    rc_vector_t T = RC_VECTOR_INITIALIZER;
+    if (extrinsics_fetch_frame_to_body(lines_reloc_cam, &R, &T)) return -1;
+    for (int i = 0; i < 3; ++i) {
+        cam->T_cam_wrt_body[i] = (float)T.d[i];
+        for (int j = 0; j < 3; ++j) cam->R_cam_to_body[i][j] = (float)R.d[i][j];
     }
+    rc_matrix_free(&R);
+    rc_vector_free(&T);
+    cam->fov_rad = (float)((double)lines_reloc_fov_deg * DEG_TO_RAD);
+    cam->range_m = lines_reloc_range_m;
+    return 0;
+}
+
+/*
+ * camera dependent relocalization data: the heading to turn to at a stop,
+ * and the tags in view along the path. Without the prediction every
+ * surveyed tag is accepted anywhere.
+ */
+static void prepare_reloc(mission_t* m)
+{
+    tag_camera_t cam;
+    m->cam_heading = 0.0f;
+    if (!lines_en_reloc || m->tags.n_tags == 0) return;
+    if (load_tag_camera(&cam)) {
+        fprintf(stderr, "WARNING: no extrinsics for %s, accepting all tags\n", lines_reloc_cam);
+        return;
+    }
+    // which way to turn the body to look at a tag at a stop
+    float ax = cam.R_cam_to_body[0][2], ay = cam.R_cam_to_body[1][2];
+    m->cam_heading = (ax*ax + ay*ay > 0.25f) ? atan2f(ay, ax) : NAN;
+
+    if (lines_reloc_range_m <= 0.0f) return;
+    if (tag_visibility_build(&m->visible, &m->path, &m->tags, &cam, &m->arena)) {
+        fprintf(stderr, "WARNING: failed to predict tag visibility, accepting all tags\n");
+        return;
+    }
+    int empty = 0;
+    for (int i = 0; i < m->visible.n_seg; ++i) {
+        if (m->visible.seg_start[i+1] == m->visible.seg_start[i]) empty++;
+    }
+    printf("Predicted %d tag sightings, no tags expected on %d of %d segments\n",
+           m->visible.n_entries, empty, m->visible.n_seg);
+}
 
-    fclose(fp);
-    printf("Loaded %d tag poses\n", tag_map_count);
+static void mission_free(mission_t* m)
+{
+    if (!m) return;
+    path_free(&m->path);
+    path_index_free(&m->index);
+    tag_map_free(&m->tags);
+    arena_release(&m->arena);
+    free(m);
+}
+
+/*
+ * read the CSV nodes and, with a spline selected, expand them into the
+ * densely sampled path that is actually flown
+ */
+static int load_csv_nodes(mission_t* m)
+{
+    if (lines_interp == LINES_LINEAR) return path_load_csv(&m->path, CSV_PATH);
+
+    path_t ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.arena = &m->arena;
+    if (path_load_csv(&ctrl, CSV_PATH)) return -1;
+
+    path_spline_t type = (lines_interp == LINES_BSPLINE) ? PATH_SPLINE_BSPLINE : PATH_SPLINE_CATMULL_ROM;
+    path_sampling_t sampling = {
+        .chord_tol = lines_chord_tol_m,
+        .vmax = lines_vmax,
+        .amax = lines_amax,
+        .rate_hz = SAMPLE_RATE_HZ
+    };
+    if (path_spline_expand(&m->path, &ctrl, type, &sampling)) {
+        fprintf(stderr, "ERROR: failed to interpolate %s\n", CSV_PATH);
+        return -1;
+    }
+    printf("Interpolated %d nodes into %d samples, %.1fm long\n",
+           ctrl.n_nodes, m->path.n_nodes, (double)m->path.length);
     return 0;
 }
 
-static CoordinateList load_csv_coordinates()
+/*
+ * The compiled path is only used while it is at least as new as the CSV it
+ * was compiled from, an edited CSV that hasn't been recompiled yet wins.
+ */
+static int bin_is_current()
 {
-    CoordinateList coordinates = { .nb_pts = 0 };
-    FILE *file = fopen(CSV_PATH, "r");
-    if (!file) {
-        perror("Could not open CSV file");
-        return coordinates;
+    struct stat bin, csv;
+    if (stat(BIN_PATH, &bin)) return 0;
+    if (stat(CSV_PATH, &csv)) return 1;
+    if (csv.st_mtime > bin.st_mtime) {
+        fprintf(stderr, "WARNING: %s is newer than %s, ignoring the compiled path until it is recompiled\n",
+                CSV_PATH, BIN_PATH);
+        return 0;
     }
+    return 1;
+}
 
-    char line[MAX_LINE];
-    while (fgets(line, MAX_LINE, file)) {
-        char *token = strtok(line, ",");
-        if (token) {
-            coordinates.coorx[coordinates.nb_pts] = atof(token);
-            token = strtok(NULL, ",");
+/*
+ * Load the mission files into a new mission. Runs off the sender thread, the
+ * result is only made visible once it is complete.
+ */
+static mission_t* mission_load()
+{
+    mission_t* m = calloc(1, sizeof(mission_t));
+    if (!m) return NULL;
+    m->path.arena = &m->arena;
+
+    const path_bin_tag_t* bin_tags = NULL;
+    int n_bin_tags = 0;
+    if (bin_is_current() && path_bin_load(BIN_PATH, &m->path, &m->limits, &bin_tags, &n_bin_tags) == 0) {
+        // zero-parse start, the compiled profile is flown as-is
+        printf("Loaded compiled path %s: %d nodes, %.1fm, %.1fs\n", BIN_PATH,
+               m->path.n_nodes, (double)m->path.length, (double)m->path.duration);
+        if (m->limits.vmax != lines_vmax || m->limits.amax != lines_amax ||
+            m->limits.jmax != lines_jmax || m->limits.corner_deviation != lines_corner_deviation) {
+            fprintf(stderr, "WARNING: %s was compiled with different lines_* limits than the config file\n", BIN_PATH);
         }
-        if (token) {
-            coordinates.coory[coordinates.nb_pts] = atof(token);
-            token = strtok(NULL, ",");
+    } else {
+        m->limits.vmax = lines_vmax;
+        m->limits.amax = lines_amax;
+        m->limits.jmax = lines_jmax;
+        m->limits.corner_deviation = lines_corner_deviation;
+        if (load_csv_nodes(m) || path_profile_plan(&m->path, &m->limits)) {
+            mission_free(m);
+            return NULL;
         }
-        if (token) {
-            coordinates.coorz[coordinates.nb_pts] = atof(token);
+        printf("Planned path: %.1fs at up to %.2fm/s\n", (double)m->path.duration, (double)m->limits.vmax);
+    }
+
+    if (path_index_build(&m->index, &m->path, INDEX_CELL_M)) {
+        fprintf(stderr, "ERROR: failed to build path index\n");
+        mission_free(m);
+        return NULL;
+    }
+
+    // a missing or bad tag map only costs relocalization, fly without it
+    int tags_failed = n_bin_tags ? load_compiled_tags(m, bin_tags, n_bin_tags)
+                                 : load_apriltag_map(m, TAG_MAP_PATH);
+    if (tags_failed) {
+        fprintf(stderr, "WARNING: no tag poses loaded\n");
+        tag_map_init(&m->tags, 0, &m->arena);
+    }
+    if (lines_en_reloc && lines_reloc_learn) {
+        int n_learned = tag_learn_merge(LEARNED_TAGS_PATH, &m->tags);
+        if (n_learned > 0) printf("Added %d learned tag poses\n", n_learned);
+        else if (n_learned < 0) fprintf(stderr, "WARNING: learned tag poses not used\n");
+    }
+    prepare_reloc(m);
+    printf("Mission memory: %zu KB\n", m->arena.used / 1024);
+
+    m->generation = __atomic_add_fetch(&mission_count, 1, __ATOMIC_SEQ_CST);
+    return m;
+}
+
+/*
+ * Make m the active mission, then wait out any reader still using the
+ * previous one before freeing it. Only this side ever waits.
+ */
+static void mission_publish(mission_t* m)
+{
+    mission_t* old = __atomic_exchange_n(&active_mission, m, __ATOMIC_SEQ_CST);
+    for (int r = 0; old && r < N_READERS; ++r) {
+        while (__atomic_load_n(&mission_in_use[r], __ATOMIC_SEQ_CST) == old) usleep(1000);
+    }
+    mission_free(old);
+}
+
+/*
+ * Reader side: announce the mission about to be read. Re-checking the active
+ * pointer afterwards closes the window where a swap and free happen between
+ * the load and the announcement. Never blocks.
+ */
+static mission_t* mission_acquire(int reader)
+{
+    mission_t* m;
+    do {
+        m = __atomic_load_n(&active_mission, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&mission_in_use[reader], m, __ATOMIC_SEQ_CST);
+    } while (m != __atomic_load_n(&active_mission, __ATOMIC_SEQ_CST));
+    return m;
+}
+
+static void mission_release(int reader)
+{
+    __atomic_store_n(&mission_in_use[reader], NULL, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * relocalization borrows the tag map of the active mission per detection,
+ * with the segment being flown if the sender is flying this same mission
+ */
+static int reloc_acquire_map(reloc_map_t* map)
+{
+    mission_t* m = mission_acquire(READER_RELOC);
+    if (!m) return -1;
+    uint64_t flown = __atomic_load_n(&flown_seg, __ATOMIC_RELAXED);
+    map->tags = &m->tags;
+    map->visible = m->visible.seg_start ? &m->visible : NULL;
+    map->seg = ((unsigned int)(flown >> 32) == m->generation) ? (int)(int32_t)(uint32_t)flown : -1;
+    return 0;
+}
+
+static void reloc_release_map()
+{
+    mission_release(READER_RELOC);
+}
+
+// load and publish the mission files, returns -1 and keeps the current mission on failure
+static int reload_mission()
+{
+    mission_t* m = mission_load();
+    if (!m) {
+        fprintf(stderr, "ERROR: failed to load path, mission unchanged\n");
+        return -1;
+    }
+    mission_publish(m);
+    return 0;
+}
+
+// file watcher and pipe callback, runs on the watcher thread
+static void on_mission_files_changed()
+{
+    // saving renames the learned file into place, which calls back again to reload with it
+    if (__atomic_exchange_n(&save_learned_requested, 0, __ATOMIC_SEQ_CST)) {
+        int n = reloc_save_learned();
+        if (n >= 0) {
+            printf("Saved learned tags, %d confirmed\n", n);
+            return;
         }
-        coordinates.nb_pts++;
     }
+    reload_mission();
+}
 
-    fclose(file);
-    return coordinates;
+// turn a path frame setpoint into the one the executor sends
+static void send_path_setpoint(const path_setpoint_t* sp, mavlink_set_position_target_local_ned_t* pos)
+{
+    memset(pos, 0, sizeof(*pos));
+    pos->coordinate_frame = MAV_FRAME_LOCAL_NED;
+    pos->target_component = AUTOPILOT_COMPID;
+    pos->x = sp->x;
+    pos->y = sp->y;
+    pos->z = sp->z;
+    pos->vx = sp->vx;
+    pos->vy = sp->vy;
+    pos->vz = sp->vz;
+    pos->afx = sp->ax;
+    pos->afy = sp->ay;
+    pos->afz = sp->az;
+    pos->yaw = sp->yaw;
+
+    if (reloc_active) {
+        reloc_map_to_local(&correction, &pos->x, &pos->y, &pos->z);
+        reloc_rotate_to_local(&correction, &pos->vx, &pos->vy);
+        reloc_rotate_to_local(&correction, &pos->afx, &pos->afy);
+        pos->yaw -= correction.yaw;
+    }
+    if (coordinate_move_home) {
+        pos->x += origin_x;
+        pos->y += origin_y;
+        pos->z = origin_z;
+        pos->vz = 0.0f;  // altitude is pinned to home, drop its feed-forward
+        pos->afz = 0.0f;
+    }
+    if (en_debug) {
+        printf("seg %4d x:%7.3f y:%7.3f z:%7.3f\n", seg_hint,
+               (double)pos->x, (double)pos->y, (double)pos->z);
+    }
 }
 
-static void generate_path_from_csv()
+/*
+ * vehicle position in the frame the path is defined in, with altitude taken
+ * from the path at arc length s when the path is flown relative to home
+ */
+static void vehicle_in_path_frame(const path_t* p, float s, float* x, float* y, float* z)
 {
-    CoordinateList list = load_csv_coordinates();
-    int cpt = 0;
-    float v = 0.1f;
-    float a = 0.0f;
+    mavlink_odometry_t odom = autopilot_monitor_get_odometry();
+    *x = odom.x;
+    *y = odom.y;
+    *z = odom.z;
+    if (reloc_active) reloc_local_to_map(&correction, x, y, z);
+    if (coordinate_move_home) {
+        int k = path_find_segment(p, s, seg_hint);
+        *x -= origin_x;
+        *y -= origin_y;
+        *z = p->z[k] + p->seg[k].uz * (s - p->seg[k].s0);
+    }
+}
 
-    for (int i = 0; i < list.nb_pts - 1; ++i) {
-        float dx = list.coorx[i+1] - list.coorx[i];
-        float dy = list.coory[i+1] - list.coory[i];
-        float dz = list.coorz[i+1] - list.coorz[i];
-        float dist = sqrtf(dx*dx + dy*dy + dz*dz);
-        int nb_pts = floorf(dist * 50);
-        if (nb_pts < 1) nb_pts = 1;
+static float wrap_pi(float a)
+{
+    return atan2f(sinf(a), cosf(a));
+}
 
-        for (int k = 0; k < nb_pts && cpt < STEPS; ++k) {
-            path[cpt].time_boot_ms = 0;
-            path[cpt].coordinate_frame = MAV_FRAME_LOCAL_NED;
-            path[cpt].type_mask = 0;
-            path[cpt].target_system = 0;
-            path[cpt].target_component = AUTOPILOT_COMPID;
+// forget any stop in progress and skip the actions already behind arc length s
+static void reset_stops(const path_t* p, float s)
+{
+    stopped = 0;
+    next_action = 0;
+    while (next_action < p->n_actions && p->action[next_action].s < s - STOP_REACH_M) next_action++;
+    if (reloc_active) reloc_watch_tag(-1);
+}
 
-            path[cpt].x = dx * k / nb_pts + list.coorx[i];
-            path[cpt].y = dy * k / nb_pts + list.coory[i];
-            path[cpt].z = dz * k / nb_pts + list.coorz[i];
+/*
+ * start the stop at the next action, returns 0 if it is passed over instead
+ * because there is no relocalization running or the tag is not surveyed
+ */
+static int begin_stop(const mission_t* m)
+{
+    const path_action_t* a = &m->path.action[next_action];
+    const apriltag_pose_t* tag = tag_map_find(&m->tags, a->tag_id);
+    if (!reloc_active || !tag) {
+        if (en_debug) printf("passing over the stop on tag %d\n", a->tag_id);
+        next_action++;
+        return 0;
+    }
 
-            path[cpt].vx = v;
-            path[cpt].vy = v;
-            path[cpt].vz = v;
+    // point the camera at the tag, a camera looking straight down needs no turn
+    float dx = tag->x - m->path.x[a->node];
+    float dy = tag->y - m->path.y[a->node];
+    stop_target_yaw = isnan(m->cam_heading) ? 0.0f : wrap_pi(atan2f(dy, dx) - m->cam_heading);
+    stop_yaw = 0.0f;
+    stop_time = 0.0f;
+    stop_phase = STOP_TURN;
+    stopped = 1;
+    reloc_watch_tag(a->tag_id);
+    printf("relocalization stop at %.1fm, looking for tag %d\n", (double)a->s, a->tag_id);
+    return 1;
+}
 
-            path[cpt].ax = a;
-            path[cpt].ay = a;
-            path[cpt].az = a;
+// turn the stop yaw toward target at STOP_YAW_RATE, returns 1 once there
+static int turn_toward(float target, float dt)
+{
+    float step = STOP_YAW_RATE * dt;
+    float err = wrap_pi(target - stop_yaw);
+    if (fabsf(err) <= step) {
+        stop_yaw = target;
+        return 1;
+    }
+    stop_yaw = wrap_pi(stop_yaw + copysignf(step, err));
+    return 0;
+}
+
+/*
+ * one tick of a relocalization stop: hold at the action's node, turn toward
+ * the tag, wait for STOP_CONFIRMATIONS or until STOP_TIMEOUT_S into the stop,
+ * and turn back to the path heading. Returns 0 once the path carries on,
+ * without sending anything that tick.
+ */
+static int stop_tick(const mission_t* m, float dt, mavlink_set_position_target_local_ned_t* out)
+{
+    const path_t* p = &m->path;
+    const path_action_t* a = &p->action[next_action];
+    stop_time += dt;
 
-            path[cpt].yaw = 0;
-            cpt++;
+    if (stop_phase == STOP_TURN) {
+        if (turn_toward(stop_target_yaw, dt)) stop_phase = STOP_WAIT;
+    }
+    if (stop_phase == STOP_WAIT || (stop_phase == STOP_TURN && stop_time > STOP_TIMEOUT_S)) {
+        int n = reloc_watch_count();
+        if (n >= STOP_CONFIRMATIONS || stop_time > STOP_TIMEOUT_S) {
+            if (n < STOP_CONFIRMATIONS) {
+                fprintf(stderr, "WARNING: tag %d confirmed %d of %d times, moving on\n",
+                        a->tag_id, n, STOP_CONFIRMATIONS);
+            }
+            reloc_watch_tag(-1);
+            stop_phase = STOP_RETURN;
         }
     }
+    if (stop_phase == STOP_RETURN && turn_toward(0.0f, dt)) {
+        stopped = 0;
+        next_action++;
+        return 0;
+    }
+
+    path_setpoint_t sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.x = p->x[a->node];
+    sp.y = p->y[a->node];
+    sp.z = p->z[a->node];
+    sp.yaw = stop_yaw;
+    send_path_setpoint(&sp, out);
+    return 1;
+}
+
+/*
+ * open loop: advance the profile by one tick and send it. After a resume the
+ * profile clock eases from standstill back up to real time over
+ * RESUME_RAMP_S so the setpoint does not leave at cruise speed. The profile
+ * is at rest at every action, the clock is held there for the stop.
+ */
+static void send_position(const mission_t* m, float dt, mavlink_set_position_target_local_ned_t* out)
+{
+    const path_t* p = &m->path;
+    if (stopped && stop_tick(m, dt, out)) return;
+
+    float k = (ramp_time < RESUME_RAMP_S) ? ramp_time / RESUME_RAMP_S : 1.0f;
+    ramp_time += dt;
+    path_time += k * dt;
+    while (!stopped && next_action < p->n_actions && path_time >= p->action[next_action].t) {
+        float t_stop = p->action[next_action].t;
+        if (begin_stop(m)) path_time = t_stop;
+    }
+
+    path_setpoint_t sp;
+    seg_hint = path_eval_at_time(p, &m->limits, path_time, seg_hint, &sp);
+    sp.vx *= k;
+    sp.vy *= k;
+    sp.vz *= k;
+    sp.ax *= k * k;
+    sp.ay *= k * k;
+    sp.az *= k * k;
+
+    const path_segment_t* g = &p->seg[seg_hint];
+    progress_s = g->s0 + (sp.x - p->x[seg_hint]) * g->ux +
+                         (sp.y - p->y[seg_hint]) * g->uy +
+                         (sp.z - p->z[seg_hint]) * g->uz;
+    send_path_setpoint(&sp, out);
+}
+
+/*
+ * closed loop: advance progress to the point on the path nearest the vehicle
+ * and send the setpoint lines_lookahead_m further along. If the vehicle
+ * falls behind the setpoint waits for it instead of running away. The
+ * setpoint never leads past a stop not made yet.
+ */
+static void send_carrot(const mission_t* m, float dt, mavlink_set_position_target_local_ned_t* out)
+{
+    const path_t* p = &m->path;
+    if (stopped && stop_tick(m, dt, out)) return;
+
+    float qx, qy, qz;
+    vehicle_in_path_frame(p, progress_s, &qx, &qy, &qz);
+
+    float s_near;
+    if (path_index_nearest(&m->index, p, qx, qy, qz,
+                           progress_s - CARROT_BEHIND_M, progress_s + CARROT_AHEAD_M,
+                           CARROT_SEARCH_M, &s_near) >= 0.0f && s_near > progress_s) {
+        progress_s = s_near;
+    }
+
+    while (!stopped && next_action < p->n_actions &&
+           progress_s >= p->action[next_action].s - STOP_REACH_M) {
+        begin_stop(m);
+    }
+
+    float s_target = progress_s + lines_lookahead_m;
+    if (s_target > p->length) s_target = p->length;
+    if (next_action < p->n_actions && s_target > p->action[next_action].s) {
+        s_target = p->action[next_action].s;
+    }
+
+    path_setpoint_t sp;
+    float t = path_time_at_s(p, &m->limits, s_target, seg_hint);
+    seg_hint = path_eval_at_time(p, &m->limits, t, seg_hint, &sp);
+    send_path_setpoint(&sp, out);
+}
+
+/*
+ * first entry into the path starts the mission from the beginning. After an
+ * offboard drop-out, pick the mission back up at the closest point of the
+ * path not yet flown instead of starting over. join joins a first entry at
+ * the closest point too, for taking over from another mode in flight.
+ */
+static void start_or_resume_mission(const mission_t* m, int join)
+{
+    const path_t* p = &m->path;
+
+    if (!mission_started) {
+        origin_x = home_position.x;
+        origin_y = home_position.y;
+        origin_z = home_position.z;
+        mission_started = 1;
+        progress_s = 0.0f;
+        path_time = 0.0f;
+        ramp_time = RESUME_RAMP_S; // the profile already starts from rest
+        reset_stops(p, 0.0f);
+        if (!join) return;
+    }
+
+    float qx, qy, qz, s_near;
+    vehicle_in_path_frame(p, progress_s, &qx, &qy, &qz);
+    if (path_index_nearest(&m->index, p, qx, qy, qz, progress_s, p->length,
+                           RESUME_SEARCH_M, &s_near) >= 0.0f) {
+        progress_s = s_near;
+    }
+    printf("resuming mission at %.1fm of %.1fm\n", (double)progress_s, (double)p->length);
+
+    seg_hint = -1;
+    path_time = path_time_at_s(p, &m->limits, progress_s, seg_hint);
+    ramp_time = 0.0f;
+    reset_stops(p, progress_s);
+}
 
-    home_position = path[0];
+/*
+ * switch the sender state over to a newly published mission. A mission
+ * swapped in mid-flight is joined at the point nearest the vehicle, one
+ * swapped in on the ground starts from its beginning.
+ */
+static void adopt_mission(const mission_t* m)
+{
+    mission_generation = m->generation;
+    seg_hint = -1;
+
+    home_position.time_boot_ms = 0;
+    home_position.coordinate_frame = MAV_FRAME_LOCAL_NED;
+    home_position.target_system = 0;
+    home_position.target_component = AUTOPILOT_COMPID;
+    home_position.x = m->path.x[0];
+    home_position.y = m->path.y[0];
+    home_position.z = m->path.z[0];
+    home_position.yaw = 0;
     home_position.type_mask = POSITION_TARGET_TYPEMASK_VX_IGNORE |
                                POSITION_TARGET_TYPEMASK_VY_IGNORE |
                                POSITION_TARGET_TYPEMASK_VZ_IGNORE |
@@ -143,86 +650,220 @@ static void generate_path_from_csv()
                                POSITION_TARGET_TYPEMASK_AY_IGNORE |
                                POSITION_TARGET_TYPEMASK_AZ_IGNORE |
                                POSITION_TARGET_TYPEMASK_YAW_RATE_IGNORE;
+
+    if (in_flight) {
+        printf("new mission loaded in flight\n");
+        progress_s = 0.0f;
+        start_or_resume_mission(m, 0);
+    } else {
+        mission_started = 0;
+    }
 }
 
-static void send_position(int i)
+// keep the odometry history detections are matched against
+static void record_odometry(int64_t now_ns)
 {
-    if (i >= STEPS || i < 0) return;
-    mavlink_set_position_target_local_ned_t pos = path[i];
-    if (coordinate_move_home) {
-        pos.x += home_position.x;
-        pos.y += home_position.y;
-        pos.z = home_position.z;
+    mavlink_odometry_t odom = autopilot_monitor_get_odometry();
+    odom_sample_t s = {
+        .timestamp_ns = now_ns,
+        .x = odom.x,
+        .y = odom.y,
+        .z = odom.z,
+        .quality = odom.quality
+    };
+    odometer_m = odom_history_push(&s);
+}
+
+/*
+ * start of every tick: pick up the current mission and adopt it if it is
+ * new, and take the latest relocalization, carried forward from the last
+ * sighting by the drift learned so far. Returns NULL until a mission has
+ * loaded. Pair with end_tick().
+ */
+static mission_t* begin_tick()
+{
+    mission_t* m = mission_acquire(READER_SENDER);
+    if (m && m->generation != mission_generation) adopt_mission(m);
+    if (reloc_active) {
+        reloc_correction_t latest;
+        int64_t now_ns = my_time_monotonic_ns();
+        record_odometry(now_ns);
+        reloc_get_correction(&latest);
+        reloc_extrapolate(&latest, now_ns, odometer_m, &correction);
     }
-    mavlink_io_send_fixed_setpoint(autopilot_monitor_get_sysid(), VOXL_COMPID, pos);
+    return m;
+}
+
+static void end_tick()
+{
+    // turned toward a tag at a stop, the visibility prediction does not apply
+    int seg = (in_flight && !stopped) ? seg_hint : -1;
+    __atomic_store_n(&flown_seg, ((uint64_t)mission_generation << 32) | (uint32_t)seg, __ATOMIC_RELAXED);
+    mission_release(READER_SENDER);
 }
 
-static void send_home_position()
+static void send_home_position(mavlink_set_position_target_local_ned_t* out)
 {
+    *out = home_position;
     if (coordinate_move_home) {
         mavlink_odometry_t odom = autopilot_monitor_get_odometry();
         home_position.x = odom.x;
         home_position.y = odom.y;
         home_position.z = odom.z;
+        *out = home_position;
+    } else if (reloc_active) {
+        // home is the start of the path, in map frame
+        reloc_map_to_local(&correction, &out->x, &out->y, &out->z);
     }
-    mavlink_io_send_fixed_setpoint(autopilot_monitor_get_sysid(), VOXL_COMPID, home_position);
 }
 
-static void* thread_func(__attribute__((unused)) void* arg)
+// tags learned in flight are saved once landed, off the executor so ticks never wait on flash
+static void save_learned_on_disarm()
 {
-    int64_t next_time = 0;
-    int i;
+    static int was_armed = 0;
+    int armed = autopilot_monitor_is_armed();
+    if (was_armed && !armed && reloc_active && lines_reloc_learn) {
+        __atomic_store_n(&save_learned_requested, 1, __ATOMIC_SEQ_CST);
+        file_watch_trigger();
+    }
+    was_armed = armed;
+}
 
-    generate_path_from_csv();
+// hold at home, sending nothing until a mission exists so offboard can't engage without one
+static int home_tick(mavlink_set_position_target_local_ned_t* out)
+{
+    save_learned_on_disarm();
+    int ret = begin_tick() ? 0 : -1;
+    if (ret == 0) send_home_position(out);
+    end_tick();
+    return ret;
+}
 
-    for (i = 100; running && i > 0; --i) {
-        send_home_position();
-        if (my_loop_sleep(RATE, &next_time)) fprintf(stderr, "WARNING thread fell behind\n");
+static int start_tick(int join)
+{
+    mission_t* m = begin_tick();
+    if (m) {
+        start_or_resume_mission(m, join);
+        in_flight = 1;
     }
+    end_tick();
+    return m ? 0 : -1;
+}
 
-HOME:
-    while (running && !autopilot_monitor_is_armed_and_in_offboard_mode()) {
-        send_home_position();
-        if (my_loop_sleep(RATE, &next_time)) fprintf(stderr, "WARNING thread fell behind\n");
+static int path_tick(mavlink_set_position_target_local_ned_t* out, float dt)
+{
+    mission_t* m = begin_tick();
+    if (lines_en_carrot) send_carrot(m, dt, out);
+    else send_position(m, dt, out);
+    end_tick();
+    return 0;
+}
+
+static void leave_path()
+{
+    in_flight = 0;
+}
+
+static const offboard_executor_mode_t lines_mode = {
+    .name  = "lines",
+    .home  = home_tick,
+    .start = start_tick,
+    .next  = path_tick,
+    .leave = leave_path
+};
+
+static void _control_pipe_cb(__attribute__((unused)) int ch, char* string, int bytes,
+                             __attribute__((unused)) void* context)
+{
+    if (bytes >= 6 && strncmp(string, "reload", 6) == 0) {
+        printf("offboard_lines: reload requested\n");
+        file_watch_trigger();
+        return;
     }
+    fprintf(stderr, "WARNING: offboard_lines got unknown command: %.*s\n", bytes, string);
+}
 
-    i = RATE * 2;
-    while (running && i > 0) {
-        if (!autopilot_monitor_is_armed_and_in_offboard_mode()) goto HOME;
-        send_home_position();
-        i--;
-        if (my_loop_sleep(RATE, &next_time)) fprintf(stderr, "WARNING thread fell behind\n");
+static void start_reload_sources()
+{
+    static const char* const names[] = { "path_points.csv", "path_points.bin", "tag_map.csv",
+                                         "tag_map_learned.bin", NULL };
+    if (file_watch_start(MISSION_DIR, names, on_mission_files_changed)) {
+        fprintf(stderr, "WARNING: not watching %s for new missions\n", MISSION_DIR);
     }
 
-    i = 0;
-    while (running) {
-        if (!autopilot_monitor_is_armed_and_in_offboard_mode()) goto HOME;
-        send_position(i++);
-        if (i >= STEPS) i = 0;
-        if (my_loop_sleep(RATE, &next_time)) fprintf(stderr, "WARNING thread fell behind\n");
+    pipe_info_t info = {
+        .name        = CONTROL_PIPE_NAME,
+        .location    = CONTROL_PIPE_NAME,
+        .type        = "text",
+        .server_name = PROCESS_NAME,
+        .size_bytes  = 1024
+    };
+    control_ch = pipe_server_get_next_available_channel();
+    if (pipe_server_create(control_ch, info, SERVER_FLAG_EN_CONTROL_PIPE)) {
+        fprintf(stderr, "WARNING: failed to create %s control pipe\n", CONTROL_PIPE_NAME);
+        control_ch = -1;
+        return;
     }
+    pipe_server_set_control_cb(control_ch, _control_pipe_cb, NULL);
+    pipe_server_set_available_control_commands(control_ch, "reload");
+}
 
-    printf("exiting offboard_lines thread\n");
-    return NULL;
+/*
+ * relocalization writes map frame setpoints for PX4's local frame, which
+ * rules out flying relative to home or having vision hub transform the
+ * setpoints from its own fixed frame as well
+ */
+static void start_reloc()
+{
+    reloc_active = 0;
+    if (!lines_en_reloc) return;
+    if (coordinate_move_home || en_tag_fixed_frame) {
+        fprintf(stderr, "WARNING: lines_en_reloc needs coordinate_move_home and en_tag_fixed_frame disabled, not relocalizing\n");
+        return;
+    }
+    if (reloc_start(reloc_acquire_map, reloc_release_map,
+                    lines_reloc_filter == LINES_RELOC_KALMAN, fixed_frame_filter_len,
+                    lines_reloc_learn ? LEARNED_TAGS_PATH : NULL) == 0) {
+        reloc_active = 1;
+    }
 }
 
 int offboard_lines_init(void)
 {
     running = 1;
-    load_apriltag_map("/data/tag_map.csv");
-    pipe_pthread_create(&thread_id, thread_func, NULL, OFFBOARD_THREAD_PRIORITY);
+    start_reloc();
+    start_reload_sources();
+    // a mode that can't fly must not take the stream over, even in flight
+    if (reload_mission()) {
+        offboard_lines_stop(1);
+        return -1;
+    }
+    offboard_executor_attach(&lines_mode);
     return 0;
 }
 
-int offboard_lines_stop(int blocking)
+int offboard_lines_stop(__attribute__((unused)) int blocking)
 {
     if (!running) return 0;
     running = 0;
-    if (blocking) pthread_join(thread_id, NULL);
+    // once detached the sender never runs again, nothing is left to wait for
+    offboard_executor_detach(&lines_mode);
+    file_watch_stop();
+    if (reloc_active) {
+        reloc_stop();
+        reloc_active = 0;
+    }
+    if (control_ch >= 0) {
+        pipe_server_close(control_ch);
+        control_ch = -1;
+    }
+    mission_publish(NULL);
+    mission_generation = 0;
     return 0;
 }
 
 void offboard_lines_en_print_debug(int debug)
 {
     if (debug) en_debug = 1;
+    reloc_en_print_debug(debug);
 }
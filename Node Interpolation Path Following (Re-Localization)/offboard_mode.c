@@ -32,12 +32,21 @@
  ******************************************************************************/
 
 
+
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <modal_pipe.h>
 
-#include "offboard_lines.h"
 #include "config_file.h"
+#include "macros.h"
 #include "offboard_mode.h"
+#include "offboard_executor.h"
+#include "rt_thread.h"
+#include "offboard_lines.h"
+#include "offboard_square.h"
+#include "offboard_coordinate.h"
 #include "offboard_figure_eight.h"
 #include "offboard_wps.h"
 #include "offboard_follow_tag.h"
@@ -46,105 +55,177 @@
 #include "offboard_backtrack.h"
 
 
-int offboard_mode_init(void)
+typedef struct offboard_mode_desc_t{
+	int  (*init)(void);
+	int  (*stop)(int blocking);
+	void (*en_print_debug)(int debug);
+	int  on_executor;	// streams through offboard_executor instead of its own thread
+} offboard_mode_desc_t;
+
+
+static int _wps_init(void)
 {
-	// start appropriate offboard mode thread
-	if(offboard_mode == FIGURE_EIGHT){
-		printf("starting offboard figure eight\n");
-		return offboard_figure_eight_init();
-	}
-	else if(offboard_mode == LINES){
-    	printf("starting offboard lines\n");
-    	return offboard_lines_init();
-	}
-	else if(offboard_mode == SQUARE){		// We added lines 55 - 62 to be able to launch the square mode or coordinates mode
-		printf("starting offboard square\n");
-		return offboard_square_init();
-	}
-		else if(offboard_mode == COORDINATES){
-		printf("starting offboard coordinates\n");
-		return offboard_coordinate_init();
-	}
-	else if(offboard_mode == FOLLOW_TAG){
-		printf("starting offboard follow tag\n");
-		return offboard_follow_tag_init();
-	}
-	else if(offboard_mode == TRAJECTORY){
-		printf("starting offboard trajectory\n");
-		return offboard_trajectory_init();
-	}
-	else if(offboard_mode == VFC){
-		printf("starting offboard vfc\n");
-		return offboard_vfc_init();
-	}
-	else if(offboard_mode == BACKTRACK){
-		printf("starting offboard backtrack\n");
-		return offboard_backtrack_init();
-	}
-	else if(offboard_mode == WPS){
-		printf("starting offboard waypoints with timeout %f and stride %f\n", (double)wps_timeout, (double)wps_stride);
-		offboard_wps_set_pause_time(wps_timeout);
-		offboard_wps_set_stride(wps_stride);
-		offboard_wps_damp(wps_damp);
-		return offboard_wps_init();
-	}
-	return 0;
+	printf("waypoints timeout %f and stride %f\n", (double)wps_timeout, (double)wps_stride);
+	offboard_wps_set_pause_time(wps_timeout);
+	offboard_wps_set_stride(wps_stride);
+	offboard_wps_damp(wps_damp);
+	return offboard_wps_init();
 }
 
 
-int offboard_mode_stop(int blocking)
+// indexed by offboard_mode_t, off has nothing to run
+static const offboard_mode_desc_t modes[N_OFFBOARD_MODES] = {
+	[OFF]          = { NULL, NULL, NULL },
+	[LINES]        = { offboard_lines_init,        offboard_lines_stop,        offboard_lines_en_print_debug, 1 },
+	[FIGURE_EIGHT] = { offboard_figure_eight_init, offboard_figure_eight_stop, offboard_figure_eight_en_print_debug },
+	[FOLLOW_TAG]   = { offboard_follow_tag_init,   offboard_follow_tag_stop,   offboard_follow_tag_en_print_debug },
+	[TRAJECTORY]   = { offboard_trajectory_init,   offboard_trajectory_stop,   offboard_trajectory_en_print_debug },
+	[VFC]          = { offboard_vfc_init,          offboard_vfc_stop,          offboard_vfc_en_print_debug },
+	[BACKTRACK]    = { offboard_backtrack_init,    offboard_backtrack_stop,    offboard_backtrack_en_print_debug },
+	[WPS]          = { _wps_init,                  offboard_wps_stop,          offboard_wps_en_print_debug },
+	[SQUARE]       = { offboard_square_init,       offboard_square_stop,       offboard_square_en_print_debug },
+	[COORDINATES]  = { offboard_coordinate_init,   offboard_coordinate_stop,   offboard_coordinate_en_print_debug },
+};
+
+static const char* const mode_strings[] = OFFBOARD_STRINGS;
+_Static_assert(sizeof(mode_strings)/sizeof(mode_strings[0]) == N_OFFBOARD_MODES,
+				"OFFBOARD_STRINGS out of step with offboard_mode_t");
+
+// held while a mode starts or stops, the control pipe and main can race
+static pthread_mutex_t mode_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int control_ch = -1;
+
+
+static int _start(offboard_mode_t mode)
 {
-	// start appropriate offboard mode thread
-	if(offboard_mode == FIGURE_EIGHT){
-		printf("stopping offboard figure eight\n");
-		return offboard_figure_eight_stop(blocking);
-	}
-	else if(offboard_mode == SQUARE){		// We added lines 97 - 104 to be able to stop the square mode or coordinates mode
-		printf("stopping offboard square\n");
-		return offboard_square_stop(blocking);
-	}
-	else if(offboard_mode == LINES){
-    	printf("stopping offboard lines\n");
-    	return offboard_lines_stop(blocking);
-	}
+	if(modes[mode].init == NULL) return 0;
+	printf("starting offboard %s\n", mode_strings[mode]);
+	return modes[mode].init();
+}
 
-	else if(offboard_mode == COORDINATES){
-		printf("stopping offboard coordinates\n");
-		return offboard_coordinate_stop(blocking);
-	}
-	else if(offboard_mode == FOLLOW_TAG){
-		printf("stopping offboard follow tag\n");
-		return offboard_follow_tag_stop(blocking);
-	}
-	else if(offboard_mode == TRAJECTORY){
-		printf("stopping offboard trajectory\n");
-		return offboard_trajectory_stop(blocking);
-	}
-	else if(offboard_mode == VFC){
-		printf("stopping offboard vfc\n");
-		return offboard_vfc_stop(blocking);
-	}
-	else if(offboard_mode == BACKTRACK){
-		printf("stopping offboard backtrack\n");
-		return offboard_backtrack_stop(blocking);
+
+static int _stop(offboard_mode_t mode, int blocking)
+{
+	if(modes[mode].stop == NULL) return 0;
+	printf("stopping offboard %s\n", mode_strings[mode]);
+	return modes[mode].stop(blocking);
+}
+
+
+int offboard_mode_switch(offboard_mode_t mode)
+{
+	if(mode < 0 || mode >= N_OFFBOARD_MODES) return -1;
+
+	pthread_mutex_lock(&mode_mutex);
+	if(mode == offboard_mode){
+		pthread_mutex_unlock(&mode_mutex);
+		return 0;
 	}
-	else if(offboard_mode == WPS){
-		printf("stopping offboard wps\n");
-		return offboard_wps_stop(blocking);
+	printf("switching offboard mode from %s to %s\n", mode_strings[offboard_mode], mode_strings[mode]);
+
+	// the old thread is joined so two modes never stream at once. A mode on
+	// the executor leaves its last setpoint held for the next one to take
+	// over from, a mode on its own thread must not be fought by that hold.
+	_stop(offboard_mode, 1);
+	if(modes[mode].on_executor) offboard_executor_hold();
+	else offboard_executor_release();
+	offboard_mode = mode;
+	int ret = _start(mode);
+	if(ret){
+		fprintf(stderr, "ERROR: failed to start offboard %s, no offboard mode running\n", mode_strings[mode]);
+		offboard_mode = OFF;
+	}
+	pthread_mutex_unlock(&mode_mutex);
+	return ret ? -1 : 0;
+}
+
+
+static void _control_pipe_cb(__attribute__((unused)) int ch, char* string, int bytes,
+							__attribute__((unused)) void* context)
+{
+	// strip the newline echo leaves on the end
+	while(bytes > 0 && (string[bytes-1] == '\n' || string[bytes-1] == '\0')) bytes--;
+
+	if(bytes == 6 && strncmp(string, "timing", 6) == 0){
+		offboard_executor_print_timing();
+		return;
+	}
+	if(bytes == 12 && strncmp(string, "timing reset", 12) == 0){
+		offboard_executor_reset_timing();
+		return;
+	}
+	if(bytes > 5 && strncmp(string, "mode ", 5) == 0){
+		const char* name = string + 5;
+		int len = bytes - 5;
+		for(int i = 0; i < N_OFFBOARD_MODES; i++){
+			if((int)strlen(mode_strings[i]) == len && strncmp(name, mode_strings[i], len) == 0){
+				offboard_mode_switch((offboard_mode_t)i);
+				return;
+			}
+		}
+	}
+	fprintf(stderr, "WARNING: offboard mode got unknown command: %.*s\n", bytes, string);
+}
+
+
+static void _start_control_pipe(void)
+{
+	char commands[512] = "timing,timing reset";
+	for(int i = 0; i < N_OFFBOARD_MODES; i++){
+		strcat(commands, ",mode ");
+		strcat(commands, mode_strings[i]);
 	}
-	return 0;
+
+	pipe_info_t info = {
+		.name        = OFFBOARD_CONTROL_PIPE,
+		.location    = OFFBOARD_CONTROL_PIPE,
+		.type        = "text",
+		.server_name = PROCESS_NAME,
+		.size_bytes  = 1024
+	};
+	control_ch = pipe_server_get_next_available_channel();
+	if(pipe_server_create(control_ch, info, SERVER_FLAG_EN_CONTROL_PIPE)){
+		fprintf(stderr, "WARNING: failed to create %s control pipe, offboard mode is fixed\n", OFFBOARD_CONTROL_PIPE);
+		control_ch = -1;
+		return;
+	}
+	pipe_server_set_control_cb(control_ch, _control_pipe_cb, NULL);
+	pipe_server_set_available_control_commands(control_ch, commands);
+}
+
+
+int offboard_mode_init(void)
+{
+	// lock memory before the executor and the first mission are touched
+	rt_lock_memory();
+	// modes can be switched to later, so the executor runs whatever the mode
+	if(offboard_executor_start()) return -1;
+	pthread_mutex_lock(&mode_mutex);
+	int ret = _start(offboard_mode);
+	pthread_mutex_unlock(&mode_mutex);
+	_start_control_pipe();
+	return ret;
 }
 
+
+int offboard_mode_stop(int blocking)
+{
+	if(control_ch >= 0){
+		pipe_server_close(control_ch);
+		control_ch = -1;
+	}
+	pthread_mutex_lock(&mode_mutex);
+	int ret = _stop(offboard_mode, blocking);
+	pthread_mutex_unlock(&mode_mutex);
+	offboard_executor_stop();
+	return ret;
+}
+
+
 void offboard_mode_en_print_debug(int debug)
 {
-	offboard_figure_eight_en_print_debug(debug);
-	offboard_lines_en_print_debug(debug);
-	offboard_square_en_print_debug(debug);		// We added lines 131 - 132 so the program can launch some debugging functions
-	offboard_coordinate_en_print_debug(debug);
-	offboard_follow_tag_en_print_debug(debug);
-	offboard_trajectory_en_print_debug(debug);
-	offboard_vfc_en_print_debug(debug);
-	offboard_backtrack_en_print_debug(debug);
-	offboard_wps_en_print_debug(debug);
+	for(int i = 0; i < N_OFFBOARD_MODES; i++){
+		if(modes[i].en_print_debug) modes[i].en_print_debug(debug);
+	}
 	return;
 }
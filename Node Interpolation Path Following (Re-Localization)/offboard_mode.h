@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * Copyright 2024 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+#ifndef OFFBOARD_MODE_H
+#define OFFBOARD_MODE_H
+
+#include "config_file.h"
+
+#define OFFBOARD_CONTROL_PIPE "vvhub_offboard" // accepts "mode <name>", "timing" and "timing reset"
+
+/**
+ * start the offboard mode from the config file and listen for mode changes
+ */
+int offboard_mode_init(void);
+
+/**
+ * stop whichever mode is running and stop listening
+ */
+int offboard_mode_stop(int blocking);
+
+/**
+ * @brief      hand the setpoint stream over to another mode
+ *
+ *             The running mode is stopped and the new one started straight
+ *             away. In offboard, a position hold streams in between when the
+ *             new mode runs on offboard_executor, so PX4 keeps getting
+ *             setpoints. Safe to call from any thread.
+ *
+ * @return     0 on success, -1 if the new mode failed to start, in which
+ *             case no mode is running
+ */
+int offboard_mode_switch(offboard_mode_t mode);
+
+void offboard_mode_en_print_debug(int debug);
+
+#endif // OFFBOARD_MODE_H
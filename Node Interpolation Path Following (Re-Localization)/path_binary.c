@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "path_binary.h"
+
+// the file stores these structs directly, catch layout changes at build time
+_Static_assert(sizeof(path_segment_t) == 6 * sizeof(float), "bump PATH_BIN_VERSION");
+_Static_assert(sizeof(path_leg_t) == 9 * sizeof(float), "bump PATH_BIN_VERSION");
+_Static_assert(sizeof(path_action_t) == 4 * sizeof(float), "bump PATH_BIN_VERSION");
+_Static_assert(sizeof(path_bin_tag_t) == 20, "bump PATH_BIN_VERSION");
+_Static_assert(sizeof(path_bin_header_t) == 120, "bump PATH_BIN_VERSION");
+
+#define ALIGN8(x) (((x) + 7u) & ~(uint64_t)7u)
+
+
+// CRC-32 (IEEE 802.3) by byte, constant so every thread can use it without setup
+static const uint32_t crc_table[256] = {
+    0x00000000u, 0x77073096u, 0xEE0E612Cu, 0x990951BAu, 0x076DC419u, 0x706AF48Fu,
+    0xE963A535u, 0x9E6495A3u, 0x0EDB8832u, 0x79DCB8A4u, 0xE0D5E91Eu, 0x97D2D988u,
+    0x09B64C2Bu, 0x7EB17CBDu, 0xE7B82D07u, 0x90BF1D91u, 0x1DB71064u, 0x6AB020F2u,
+    0xF3B97148u, 0x84BE41DEu, 0x1ADAD47Du, 0x6DDDE4EBu, 0xF4D4B551u, 0x83D385C7u,
+    0x136C9856u, 0x646BA8C0u, 0xFD62F97Au, 0x8A65C9ECu, 0x14015C4Fu, 0x63066CD9u,
+    0xFA0F3D63u, 0x8D080DF5u, 0x3B6E20C8u, 0x4C69105Eu, 0xD56041E4u, 0xA2677172u,
+    0x3C03E4D1u, 0x4B04D447u, 0xD20D85FDu, 0xA50AB56Bu, 0x35B5A8FAu, 0x42B2986Cu,
+    0xDBBBC9D6u, 0xACBCF940u, 0x32D86CE3u, 0x45DF5C75u, 0xDCD60DCFu, 0xABD13D59u,
+    0x26D930ACu, 0x51DE003Au, 0xC8D75180u, 0xBFD06116u, 0x21B4F4B5u, 0x56B3C423u,
+    0xCFBA9599u, 0xB8BDA50Fu, 0x2802B89Eu, 0x5F058808u, 0xC60CD9B2u, 0xB10BE924u,
+    0x2F6F7C87u, 0x58684C11u, 0xC1611DABu, 0xB6662D3Du, 0x76DC4190u, 0x01DB7106u,
+    0x98D220BCu, 0xEFD5102Au, 0x71B18589u, 0x06B6B51Fu, 0x9FBFE4A5u, 0xE8B8D433u,
+    0x7807C9A2u, 0x0F00F934u, 0x9609A88Eu, 0xE10E9818u, 0x7F6A0DBBu, 0x086D3D2Du,
+    0x91646C97u, 0xE6635C01u, 0x6B6B51F4u, 0x1C6C6162u, 0x856530D8u, 0xF262004Eu,
+    0x6C0695EDu, 0x1B01A57Bu, 0x8208F4C1u, 0xF50FC457u, 0x65B0D9C6u, 0x12B7E950u,
+    0x8BBEB8EAu, 0xFCB9887Cu, 0x62DD1DDFu, 0x15DA2D49u, 0x8CD37CF3u, 0xFBD44C65u,
+    0x4DB26158u, 0x3AB551CEu, 0xA3BC0074u, 0xD4BB30E2u, 0x4ADFA541u, 0x3DD895D7u,
+    0xA4D1C46Du, 0xD3D6F4FBu, 0x4369E96Au, 0x346ED9FCu, 0xAD678846u, 0xDA60B8D0u,
+    0x44042D73u, 0x33031DE5u, 0xAA0A4C5Fu, 0xDD0D7CC9u, 0x5005713Cu, 0x270241AAu,
+    0xBE0B1010u, 0xC90C2086u, 0x5768B525u, 0x206F85B3u, 0xB966D409u, 0xCE61E49Fu,
+    0x5EDEF90Eu, 0x29D9C998u, 0xB0D09822u, 0xC7D7A8B4u, 0x59B33D17u, 0x2EB40D81u,
+    0xB7BD5C3Bu, 0xC0BA6CADu, 0xEDB88320u, 0x9ABFB3B6u, 0x03B6E20Cu, 0x74B1D29Au,
+    0xEAD54739u, 0x9DD277AFu, 0x04DB2615u, 0x73DC1683u, 0xE3630B12u, 0x94643B84u,
+    0x0D6D6A3Eu, 0x7A6A5AA8u, 0xE40ECF0Bu, 0x9309FF9Du, 0x0A00AE27u, 0x7D079EB1u,
+    0xF00F9344u, 0x8708A3D2u, 0x1E01F268u, 0x6906C2FEu, 0xF762575Du, 0x806567CBu,
+    0x196C3671u, 0x6E6B06E7u, 0xFED41B76u, 0x89D32BE0u, 0x10DA7A5Au, 0x67DD4ACCu,
+    0xF9B9DF6Fu, 0x8EBEEFF9u, 0x17B7BE43u, 0x60B08ED5u, 0xD6D6A3E8u, 0xA1D1937Eu,
+    0x38D8C2C4u, 0x4FDFF252u, 0xD1BB67F1u, 0xA6BC5767u, 0x3FB506DDu, 0x48B2364Bu,
+    0xD80D2BDAu, 0xAF0A1B4Cu, 0x36034AF6u, 0x41047A60u, 0xDF60EFC3u, 0xA867DF55u,
+    0x316E8EEFu, 0x4669BE79u, 0xCB61B38Cu, 0xBC66831Au, 0x256FD2A0u, 0x5268E236u,
+    0xCC0C7795u, 0xBB0B4703u, 0x220216B9u, 0x5505262Fu, 0xC5BA3BBEu, 0xB2BD0B28u,
+    0x2BB45A92u, 0x5CB36A04u, 0xC2D7FFA7u, 0xB5D0CF31u, 0x2CD99E8Bu, 0x5BDEAE1Du,
+    0x9B64C2B0u, 0xEC63F226u, 0x756AA39Cu, 0x026D930Au, 0x9C0906A9u, 0xEB0E363Fu,
+    0x72076785u, 0x05005713u, 0x95BF4A82u, 0xE2B87A14u, 0x7BB12BAEu, 0x0CB61B38u,
+    0x92D28E9Bu, 0xE5D5BE0Du, 0x7CDCEFB7u, 0x0BDBDF21u, 0x86D3D2D4u, 0xF1D4E242u,
+    0x68DDB3F8u, 0x1FDA836Eu, 0x81BE16CDu, 0xF6B9265Bu, 0x6FB077E1u, 0x18B74777u,
+    0x88085AE6u, 0xFF0F6A70u, 0x66063BCAu, 0x11010B5Cu, 0x8F659EFFu, 0xF862AE69u,
+    0x616BFFD3u, 0x166CCF45u, 0xA00AE278u, 0xD70DD2EEu, 0x4E048354u, 0x3903B3C2u,
+    0xA7672661u, 0xD06016F7u, 0x4969474Du, 0x3E6E77DBu, 0xAED16A4Au, 0xD9D65ADCu,
+    0x40DF0B66u, 0x37D83BF0u, 0xA9BCAE53u, 0xDEBB9EC5u, 0x47B2CF7Fu, 0x30B5FFE9u,
+    0xBDBDF21Cu, 0xCABAC28Au, 0x53B39330u, 0x24B4A3A6u, 0xBAD03605u, 0xCDD70693u,
+    0x54DE5729u, 0x23D967BFu, 0xB3667A2Eu, 0xC4614AB8u, 0x5D681B02u, 0x2A6F2B94u,
+    0xB40BBE37u, 0xC30C8EA1u, 0x5A05DF1Bu, 0x2D02EF8Du
+};
+
+static uint32_t crc_update(uint32_t crc, const void* data, uint64_t len)
+{
+    const uint8_t* b = data;
+    for (uint64_t i = 0; i < len; ++i) crc = crc_table[(crc ^ b[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t path_bin_crc32(const void* data, uint64_t len)
+{
+    return crc_update(0xFFFFFFFFu, data, len) ^ 0xFFFFFFFFu;
+}
+
+// checksum of a whole compiled file, the header counting with its crc32 field zeroed
+static uint32_t file_crc32(const path_bin_header_t* h, const void* payload)
+{
+    path_bin_header_t zeroed = *h;
+    zeroed.crc32 = 0;
+    uint32_t crc = crc_update(0xFFFFFFFFu, &zeroed, sizeof(zeroed));
+    return crc_update(crc, payload, h->file_size - sizeof(zeroed)) ^ 0xFFFFFFFFu;
+}
+
+
+int path_bin_write(const char* file, const path_t* p, const path_limits_t* lim,
+                   const path_bin_tag_t* tags, int n_tags)
+{
+    if (p->n_nodes < 2 || p->n_legs < 1 || p->duration <= 0.0f) {
+        fprintf(stderr, "ERROR: path must be planned before it is compiled\n");
+        return -1;
+    }
+    if (n_tags < 0 || (n_tags > 0 && !tags)) return -1;
+
+    path_bin_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = PATH_BIN_MAGIC;
+    h.version = PATH_BIN_VERSION;
+    h.header_size = sizeof(h);
+    h.n_nodes = p->n_nodes;
+    h.n_tags = n_tags;
+    h.n_legs = p->n_legs;
+    h.n_actions = p->n_actions;
+    h.limits = *lim;
+    h.length = p->length;
+    h.duration = p->duration;
+
+    uint64_t node_bytes = (uint64_t)p->n_nodes * sizeof(float);
+    h.off_x = ALIGN8(sizeof(h));
+    h.off_y = ALIGN8(h.off_x + node_bytes);
+    h.off_z = ALIGN8(h.off_y + node_bytes);
+    h.off_seg = ALIGN8(h.off_z + node_bytes);
+    h.off_leg = ALIGN8(h.off_seg + (uint64_t)(p->n_nodes - 1) * sizeof(path_segment_t));
+    h.off_action = ALIGN8(h.off_leg + (uint64_t)p->n_legs * sizeof(path_leg_t));
+    h.off_tags = ALIGN8(h.off_action + (uint64_t)p->n_actions * sizeof(path_action_t));
+    h.file_size = h.off_tags + (uint64_t)n_tags * sizeof(path_bin_tag_t);
+
+    // assemble the payload in memory so the checksum covers exactly what is written
+    uint8_t* buf = calloc(1, h.file_size);
+    if (!buf) {
+        fprintf(stderr, "ERROR: out of memory compiling %s\n", file);
+        return -1;
+    }
+    memcpy(buf + h.off_x, p->x, node_bytes);
+    memcpy(buf + h.off_y, p->y, node_bytes);
+    memcpy(buf + h.off_z, p->z, node_bytes);
+    memcpy(buf + h.off_seg, p->seg, (p->n_nodes - 1) * sizeof(path_segment_t));
+    memcpy(buf + h.off_leg, p->leg, p->n_legs * sizeof(path_leg_t));
+    if (p->n_actions) memcpy(buf + h.off_action, p->action, p->n_actions * sizeof(path_action_t));
+    if (n_tags) memcpy(buf + h.off_tags, tags, n_tags * sizeof(path_bin_tag_t));
+    h.crc32 = file_crc32(&h, buf + sizeof(h));
+    memcpy(buf, &h, sizeof(h));
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror("Could not open compiled path for writing");
+        free(buf);
+        return -1;
+    }
+    int ok = fwrite(buf, 1, h.file_size, fp) == h.file_size;
+    ok = (fclose(fp) == 0) && ok;
+    free(buf);
+
+    if (!ok || rename(tmp, file)) {
+        fprintf(stderr, "ERROR: failed to write %s\n", file);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+
+static void free_unless_arena(const path_t* p, void* buf)
+{
+    if (!p->arena) free(buf);
+}
+
+
+int path_bin_load(const char* file, path_t* p, path_limits_t* lim,
+                  const path_bin_tag_t** tags, int* n_tags)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) || (uint64_t)st.st_size < sizeof(path_bin_header_t)) {
+        fprintf(stderr, "ERROR: %s is too small to be a compiled path\n", file);
+        close(fd);
+        return -1;
+    }
+
+    // copied in rather than mapped, so a file overwritten in place can't
+    // truncate or change the mission under the sender
+    uint8_t* buf = p->arena ? arena_alloc(p->arena, st.st_size) : malloc(st.st_size);
+    if (!buf) {
+        fprintf(stderr, "ERROR: out of memory loading %s\n", file);
+        close(fd);
+        return -1;
+    }
+    off_t got = 0;
+    while (got < st.st_size) {
+        ssize_t n = read(fd, buf + got, st.st_size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+    }
+    close(fd);
+    if (got != st.st_size) {
+        fprintf(stderr, "ERROR: %s: short read\n", file);
+        free_unless_arena(p, buf);
+        return -1;
+    }
+
+    const path_bin_header_t* h = (const path_bin_header_t*)buf;
+    const char* err = NULL;
+    if (h->magic != PATH_BIN_MAGIC) err = "bad magic number";
+    else if (h->version != PATH_BIN_VERSION) err = "unsupported version, recompile the mission";
+    else if (h->header_size != sizeof(*h) || h->file_size != (uint64_t)st.st_size) err = "truncated file";
+    else if (file_crc32(h, buf + sizeof(*h)) != h->crc32) err = "checksum mismatch";
+    else if (h->off_x < h->header_size ||
+             ((h->off_x | h->off_y | h->off_z | h->off_seg | h->off_leg | h->off_action | h->off_tags) & 7)) err = "misaligned offsets";
+    else if (h->n_nodes < 2 || h->n_legs < 1 || h->n_legs > h->n_nodes - 1) err = "bad node or leg count";
+    else if (h->off_tags + (uint64_t)h->n_tags * sizeof(path_bin_tag_t) > h->file_size ||
+             h->off_action + (uint64_t)h->n_actions * sizeof(path_action_t) > h->off_tags ||
+             h->off_leg + (uint64_t)h->n_legs * sizeof(path_leg_t) > h->off_action ||
+             h->off_seg + (uint64_t)(h->n_nodes - 1) * sizeof(path_segment_t) > h->off_leg ||
+             h->off_x + (uint64_t)h->n_nodes * sizeof(float) > h->off_y ||
+             h->off_y + (uint64_t)h->n_nodes * sizeof(float) > h->off_z ||
+             h->off_z + (uint64_t)h->n_nodes * sizeof(float) > h->off_seg) err = "corrupt offsets";
+    // the sender uses these straight from the header
+    else if (!(h->limits.vmax > 0.0f) || !(h->limits.amax > 0.0f) || !(h->limits.jmax > 0.0f) ||
+             !(h->limits.corner_deviation >= 0.0f) || !isfinite(h->limits.vmax) || !isfinite(h->limits.amax) ||
+             !isfinite(h->limits.jmax) || !isfinite(h->limits.corner_deviation)) err = "bad limits";
+    else if (!(h->length >= 0.0f) || !isfinite(h->length) ||
+             !(h->duration > 0.0f) || !isfinite(h->duration)) err = "bad length or duration";
+    if (!err) {
+        // the evaluator indexes legs through the segments, keep it in bounds
+        const path_segment_t* seg = (const path_segment_t*)(buf + h->off_seg);
+        for (uint32_t i = 0; i < h->n_nodes - 1; ++i) {
+            if (seg[i].leg < 0 || (uint32_t)seg[i].leg >= h->n_legs) {
+                err = "segment refers to a missing leg";
+                break;
+            }
+        }
+        // and the sender walks actions in node order
+        const path_action_t* action = (const path_action_t*)(buf + h->off_action);
+        for (uint32_t k = 0; !err && k < h->n_actions; ++k) {
+            if (action[k].node < 0 || (uint32_t)action[k].node >= h->n_nodes ||
+                (k > 0 && action[k].node < action[k-1].node)) {
+                err = "action at a missing or out of order node";
+            }
+        }
+    }
+    if (err) {
+        fprintf(stderr, "ERROR: %s: %s\n", file, err);
+        free_unless_arena(p, buf);
+        return -1;
+    }
+
+    path_free(p);
+    p->n_nodes = h->n_nodes;
+    p->x = (float*)(buf + h->off_x);
+    p->y = (float*)(buf + h->off_y);
+    p->z = (float*)(buf + h->off_z);
+    p->seg = (path_segment_t*)(buf + h->off_seg);
+    p->leg = (path_leg_t*)(buf + h->off_leg);
+    p->n_legs = h->n_legs;
+    p->action = h->n_actions ? (path_action_t*)(buf + h->off_action) : NULL;
+    p->n_actions = h->n_actions;
+    p->length = h->length;
+    p->duration = h->duration;
+    p->compiled = buf;
+
+    if (lim) *lim = h->limits;
+    if (tags) *tags = (const path_bin_tag_t*)(buf + h->off_tags);
+    if (n_tags) *n_tags = h->n_tags;
+    return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef PATH_BINARY_H
+#define PATH_BINARY_H
+
+#include <stdint.h>
+
+#include "path_segments.h"
+#include "path_profile.h"
+
+/**
+ * Compiled mission file.
+ *
+ * path_compiler turns path_points.csv and tag_map.csv into one blob holding
+ * the nodes, the planned segments, legs and actions and the tag poses. offboard_lines reads it
+ * into the mission in one go: the arrays are used in place, with no parsing.
+ * It is copied rather than mapped so a file overwritten in place while in use
+ * can't truncate the mission under the sender, a torn read fails the checksum.
+ *
+ * Layout, all offsets from the start of the file and 8-byte aligned:
+ *   path_bin_header_t
+ *   float x[n_nodes], y[n_nodes], z[n_nodes]
+ *   path_segment_t seg[n_nodes-1]
+ *   path_leg_t leg[n_legs]
+ *   path_action_t action[n_actions]
+ *   path_bin_tag_t tags[n_tags]
+ *
+ * The file is native little-endian, which covers both the VOXL and the
+ * x86 machine the mission is compiled on.
+ */
+
+#define PATH_BIN_MAGIC      0x4E54414Cu // "LATN" little-endian
+#define PATH_BIN_VERSION    4
+
+typedef struct path_bin_tag_t {
+    int32_t id;
+    float x, y, z;
+    float yaw_deg;
+} path_bin_tag_t;
+
+typedef struct path_bin_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t crc32;             // CRC-32 of the whole file, this field taken as 0
+    uint64_t file_size;
+    uint32_t n_nodes;
+    uint32_t n_tags;
+    uint32_t n_legs;
+    uint32_t n_actions;
+    path_limits_t limits;       // limits the profile was planned with
+    float length;
+    float duration;
+    uint64_t off_x;
+    uint64_t off_y;
+    uint64_t off_z;
+    uint64_t off_seg;
+    uint64_t off_leg;
+    uint64_t off_action;
+    uint64_t off_tags;
+} path_bin_header_t;
+
+
+/**
+ * @brief      write a planned path and optional tag poses to a compiled file
+ *
+ *             The file is written next to the destination and renamed into
+ *             place so a reader never loads a half-written file.
+ *
+ * @return     0 on success, -1 on failure
+ */
+int path_bin_write(const char* file, const path_t* p, const path_limits_t* lim,
+                   const path_bin_tag_t* tags, int n_tags);
+
+/**
+ * @brief      read a compiled file and point p at its arrays
+ *
+ *             The file is read into one buffer from p's arena, or malloced
+ *             without one, and the magic, version, sizes and checksum are
+ *             validated before anything is used. The arrays are read-only,
+ *             path_free() or releasing the arena frees them.
+ *
+ * @param[out] lim     limits the profile was planned with
+ * @param[out] tags    tag poses inside the buffer, may be NULL
+ * @param[out] n_tags  number of tag poses, may be NULL
+ *
+ * @return     0 on success, -1 on failure
+ */
+int path_bin_load(const char* file, path_t* p, path_limits_t* lim,
+                  const path_bin_tag_t** tags, int* n_tags);
+
+// CRC-32 (IEEE 802.3) of a buffer
+uint32_t path_bin_crc32(const void* data, uint64_t len);
+
+#endif // PATH_BINARY_H
@@ -0,0 +1,196 @@
+/*
+ * path_compiler: offline tool that turns path_points.csv (and optionally
+ * tag_map.csv) into the compiled mission file offboard_lines loads at startup.
+ *
+ * build on the host or on VOXL:
+ *     gcc -O2 -o path_compiler path_compiler.c path_binary.c path_segments.c path_profile.c path_spline.c tag_map.c csv_reader.c arena.c -lm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "path_segments.h"
+#include "path_profile.h"
+#include "path_binary.h"
+#include "path_spline.h"
+#include "tag_map.h"
+
+
+static void _print_usage(void)
+{
+    printf("\n\
+usage: path_compiler [options] path_points.csv out.bin\n\
+\n\
+Plans the velocity profile for the path and writes nodes, segments and tag\n\
+poses to a compiled mission file. Copy it to /data/path_points.bin on VOXL.\n\
+The limits should match lines_vmax etc. in voxl-vision-hub.conf, the compiled\n\
+profile is what gets flown. A tag id in an optional fourth column of a node\n\
+stops the vehicle there to relocalize on that tag.\n\
+\n\
+-v, --vmax <m/s>            max speed, default 1.0\n\
+-a, --amax <m/s^2>          max acceleration, default 1.0\n\
+-j, --jmax <m/s^3>          max jerk, default 3.0\n\
+-c, --corner <m>            corner junction deviation, default 0.05\n\
+-t, --tags <tag_map.csv>    include tag poses: id,x,y,z,yaw_deg per line\n\
+-i, --interp <type>         linear (default), catmull_rom or bspline\n\
+-e, --chord-tol <m>         spline chord tolerance, default 0.02\n\
+-r, --rate <hz>             curve sample spacing as a setpoint rate, default 30\n\
+-b, --bench                 print how long each stage takes\n\
+-h, --help                  print this help message\n\
+\n");
+}
+
+
+static double _now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+
+static int load_tags(const char* file, path_bin_tag_t** tags, int* n_tags)
+{
+    // same checks and duplicate handling as offboard_lines loading the CSV itself
+    tag_map_t map;
+    if (tag_map_load_csv(&map, file, NULL)) {
+        tag_map_free(&map);
+        return -1;
+    }
+
+    *tags = malloc((map.n_tags ? map.n_tags : 1) * sizeof(path_bin_tag_t));
+    if (!*tags) {
+        tag_map_free(&map);
+        return -1;
+    }
+    for (int i = 0; i < map.n_tags; ++i) {
+        (*tags)[i].id = map.tags[i].id;
+        (*tags)[i].x = map.tags[i].x;
+        (*tags)[i].y = map.tags[i].y;
+        (*tags)[i].z = map.tags[i].z;
+        (*tags)[i].yaw_deg = map.tags[i].yaw_deg;
+    }
+    *n_tags = map.n_tags;
+    tag_map_free(&map);
+    return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    path_limits_t lim = { .vmax = 1.0f, .amax = 1.0f, .jmax = 3.0f, .corner_deviation = 0.05f };
+    const char* tag_file = NULL;
+    int en_bench = 0;
+    path_spline_t interp = PATH_SPLINE_LINEAR;
+    path_sampling_t sampling = { .chord_tol = 0.02f, .rate_hz = 30.0f };
+
+    static struct option long_options[] =
+    {
+        {"vmax",    required_argument, 0, 'v'},
+        {"amax",    required_argument, 0, 'a'},
+        {"jmax",    required_argument, 0, 'j'},
+        {"corner",  required_argument, 0, 'c'},
+        {"tags",    required_argument, 0, 't'},
+        {"interp",  required_argument, 0, 'i'},
+        {"chord-tol", required_argument, 0, 'e'},
+        {"rate",    required_argument, 0, 'r'},
+        {"bench",   no_argument,       0, 'b'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "v:a:j:c:t:i:e:r:bh", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'v': lim.vmax = atof(optarg); break;
+        case 'a': lim.amax = atof(optarg); break;
+        case 'j': lim.jmax = atof(optarg); break;
+        case 'c': lim.corner_deviation = atof(optarg); break;
+        case 't': tag_file = optarg; break;
+        case 'i':
+            if (strcmp(optarg, "linear") == 0) interp = PATH_SPLINE_LINEAR;
+            else if (strcmp(optarg, "catmull_rom") == 0) interp = PATH_SPLINE_CATMULL_ROM;
+            else if (strcmp(optarg, "bspline") == 0) interp = PATH_SPLINE_BSPLINE;
+            else {
+                _print_usage();
+                return -1;
+            }
+            break;
+        case 'e': sampling.chord_tol = atof(optarg); break;
+        case 'r': sampling.rate_hz = atof(optarg); break;
+        case 'b': en_bench = 1; break;
+        case 'h':
+        default:
+            _print_usage();
+            return -1;
+        }
+    }
+    if (argc - optind != 2) {
+        _print_usage();
+        return -1;
+    }
+    const char* csv_file = argv[optind];
+    const char* out_file = argv[optind + 1];
+
+    path_t path;
+    memset(&path, 0, sizeof(path));
+    double t0 = _now_ms();
+    if (path_load_csv(&path, csv_file)) return -1;
+    double t1 = _now_ms();
+    int n_rows = path.n_nodes;
+    if (interp != PATH_SPLINE_LINEAR) {
+        path_t ctrl = path;
+        memset(&path, 0, sizeof(path));
+        sampling.vmax = lim.vmax;
+        sampling.amax = lim.amax;
+        int ret = path_spline_expand(&path, &ctrl, interp, &sampling);
+        path_free(&ctrl);
+        if (ret) return -1;
+        printf("interpolated into %d samples, %.1fm long\n", path.n_nodes, (double)path.length);
+    }
+    double t1s = _now_ms();
+    if (path_profile_plan(&path, &lim)) return -1;
+    double t2 = _now_ms();
+
+    path_bin_tag_t* tags = NULL;
+    int n_tags = 0;
+    if (tag_file && load_tags(tag_file, &tags, &n_tags)) {
+        fprintf(stderr, "ERROR: failed to load %s\n", tag_file);
+        return -1;
+    }
+
+    // a stop on a tag that is not surveyed would only ever time out
+    for (int a = 0; tag_file && a < path.n_actions; ++a) {
+        int found = 0;
+        for (int k = 0; k < n_tags && !found; ++k) found = (tags[k].id == path.action[a].tag_id);
+        if (!found) {
+            fprintf(stderr, "WARNING: stop at node %d is on tag %d, missing from %s\n",
+                    path.action[a].node, path.action[a].tag_id, tag_file);
+        }
+    }
+
+    double t3 = _now_ms();
+    if (path_bin_write(out_file, &path, &lim, tags, n_tags)) return -1;
+    double t4 = _now_ms();
+
+    if (en_bench) {
+        printf("parse + segments: %8.1fms  %.1f Mrows/s\n", t1 - t0,
+               n_rows / ((t1 - t0) * 1e3));
+        if (interp != PATH_SPLINE_LINEAR) {
+            printf("spline:           %8.1fms  %.1f Msamples/s\n", t1s - t1,
+                   path.n_nodes / ((t1s - t1) * 1e3));
+        }
+        printf("profile:          %8.1fms\n", t2 - t1s);
+        printf("tags:             %8.1fms\n", t3 - t2);
+        printf("write:            %8.1fms\n", t4 - t3);
+    }
+    printf("wrote %s: %d nodes, %d tags, %d stops, %.1fm, %.1fs\n", out_file,
+           path.n_nodes, n_tags, path.n_actions, (double)path.length, (double)path.duration);
+
+    free(tags);
+    path_free(&path);
+    return 0;
+}
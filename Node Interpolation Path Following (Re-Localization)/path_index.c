@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "path_index.h"
+
+
+static unsigned int cell_hash(int ix, int iy, int iz)
+{
+    return ((unsigned int)ix * 73856093u) ^
+           ((unsigned int)iy * 19349663u) ^
+           ((unsigned int)iz * 83492791u);
+}
+
+/*
+ * Walk segment i in steps of half a cell and report the bucket of every new
+ * cell entered. With count set, only tally bucket sizes, otherwise write the
+ * segment id at the fill cursor of each bucket.
+ */
+static void register_segment(const path_index_t* idx, const path_t* p, int i, int* cursor, int count)
+{
+    const path_segment_t* g = &p->seg[i];
+    float h = 0.5f * idx->cell;
+    int steps = (int)ceilf(g->len / h);
+    int px = 0, py = 0, pz = 0;
+
+    for (int k = 0; k <= steps; ++k) {
+        float d = k * h;
+        if (d > g->len) d = g->len;
+        int ix = (int)floorf((p->x[i] + g->ux * d) / idx->cell);
+        int iy = (int)floorf((p->y[i] + g->uy * d) / idx->cell);
+        int iz = (int)floorf((p->z[i] + g->uz * d) / idx->cell);
+        if (k > 0 && ix == px && iy == py && iz == pz) continue;
+        px = ix; py = iy; pz = iz;
+
+        unsigned int b = cell_hash(ix, iy, iz) & idx->mask;
+        if (count) cursor[b]++;
+        else idx->entries[cursor[b]++] = i;
+    }
+}
+
+
+int path_index_build(path_index_t* idx, const path_t* p, float cell_size)
+{
+    memset(idx, 0, sizeof(*idx));
+    if (p->n_nodes < 2 || cell_size <= 0.0f) return -1;
+    idx->cell = cell_size;
+
+    // size the table from the number of cells the path can touch
+    long cells = (long)(2.0f * p->length / cell_size) + p->n_nodes;
+    unsigned int n_buckets = 64;
+    while (n_buckets < 2 * cells && n_buckets < (1u << 24)) n_buckets <<= 1;
+    idx->mask = n_buckets - 1;
+
+    idx->bucket_start = calloc(n_buckets + 1, sizeof(int));
+    int* cursor = calloc(n_buckets, sizeof(int));
+    if (!idx->bucket_start || !cursor) {
+        free(cursor);
+        path_index_free(idx);
+        return -1;
+    }
+
+    for (int i = 0; i < p->n_nodes - 1; ++i) register_segment(idx, p, i, cursor, 1);
+    for (unsigned int b = 0; b < n_buckets; ++b) {
+        idx->bucket_start[b+1] = idx->bucket_start[b] + cursor[b];
+        cursor[b] = idx->bucket_start[b];
+    }
+    idx->n_entries = idx->bucket_start[n_buckets];
+
+    idx->entries = malloc((idx->n_entries ? idx->n_entries : 1) * sizeof(int));
+    if (!idx->entries) {
+        free(cursor);
+        path_index_free(idx);
+        return -1;
+    }
+    for (int i = 0; i < p->n_nodes - 1; ++i) register_segment(idx, p, i, cursor, 0);
+
+    free(cursor);
+    return 0;
+}
+
+
+// test every segment in one bucket against the current best
+static void scan_bucket(const path_index_t* idx, const path_t* p, unsigned int b,
+                        float x, float y, float z, float s_min, float s_max,
+                        float* best_d2, float* best_s)
+{
+    for (int e = idx->bucket_start[b]; e < idx->bucket_start[b+1]; ++e) {
+        int i = idx->entries[e];
+        const path_segment_t* g = &p->seg[i];
+
+        // clip the segment to the allowed arc length window
+        float lo = s_min - g->s0;
+        float hi = s_max - g->s0;
+        if (lo < 0.0f) lo = 0.0f;
+        if (hi > g->len) hi = g->len;
+        if (lo > hi) continue;
+
+        float dx = x - p->x[i];
+        float dy = y - p->y[i];
+        float dz = z - p->z[i];
+        float t = dx * g->ux + dy * g->uy + dz * g->uz;
+        if (t < lo) t = lo;
+        if (t > hi) t = hi;
+        dx -= g->ux * t;
+        dy -= g->uy * t;
+        dz -= g->uz * t;
+
+        float d2 = dx*dx + dy*dy + dz*dz;
+        if (d2 < *best_d2) {
+            *best_d2 = d2;
+            *best_s = g->s0 + t;
+        }
+    }
+}
+
+
+float path_index_nearest(const path_index_t* idx, const path_t* p,
+                         float x, float y, float z,
+                         float s_min, float s_max, float max_dist, float* s_out)
+{
+    if (!idx->entries || s_min > s_max) return -1.0f;
+
+    int cx = (int)floorf(x / idx->cell);
+    int cy = (int)floorf(y / idx->cell);
+    int cz = (int)floorf(z / idx->cell);
+    int max_ring = (int)ceilf(max_dist / idx->cell) + 1;
+    float best_d2 = max_dist * max_dist;
+    float best_s = -1.0f;
+
+    // grow a cube of cells one shell at a time around the query point
+    for (int r = 0; r <= max_ring; ++r) {
+        for (int dx = -r; dx <= r; ++dx) {
+            for (int dy = -r; dy <= r; ++dy) {
+                int on_shell = (abs(dx) == r || abs(dy) == r);
+                int step = on_shell ? 1 : 2 * r;
+                for (int dz = -r; dz <= r; dz += (step ? step : 1)) {
+                    unsigned int b = cell_hash(cx + dx, cy + dy, cz + dz) & idx->mask;
+                    scan_bucket(idx, p, b, x, y, z, s_min, s_max, &best_d2, &best_s);
+                }
+            }
+        }
+
+        // cells beyond this shell are at least r cells away, and every part
+        // of a segment is within half a cell of one of its registered cells
+        float reach = r * idx->cell - 0.5f * idx->cell;
+        if (best_s >= 0.0f && reach > 0.0f && best_d2 <= reach * reach) break;
+    }
+
+    if (best_s < 0.0f) return -1.0f;
+    *s_out = best_s;
+    return sqrtf(best_d2);
+}
+
+
+void path_index_free(path_index_t* idx)
+{
+    free(idx->bucket_start);
+    free(idx->entries);
+    memset(idx, 0, sizeof(*idx));
+}
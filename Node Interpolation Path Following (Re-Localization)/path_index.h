@@ -0,0 +1,50 @@
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include "path_segments.h"
+
+/**
+ * Hashed uniform grid over the segments of a path for nearest-point queries.
+ *
+ * Each segment is registered in every cell it passes through. Cells are
+ * hashed into a fixed bucket table stored CSR-style (bucket offsets plus one
+ * flat array of segment ids), so the index is two allocations regardless of
+ * how far the path spreads and a query only touches the cells around it.
+ */
+
+typedef struct path_index_t {
+    float cell;             // cell edge length (m)
+    unsigned int mask;      // n_buckets-1, n_buckets is a power of two
+    int* bucket_start;      // n_buckets+1 offsets into entries
+    int* entries;           // segment ids
+    int n_entries;
+} path_index_t;
+
+
+/**
+ * @brief      build the index for a path with segments already built
+ *
+ * @return     0 on success, -1 on failure
+ */
+int path_index_build(path_index_t* idx, const path_t* p, float cell_size);
+
+/**
+ * @brief      find the closest point on the path to (x,y,z)
+ *
+ *             Only the part of the path with arc length in [s_min, s_max] is
+ *             considered, which keeps the match near current progress where
+ *             the path crosses itself.
+ *
+ * @param[in]  max_dist  give up on points further away than this (m)
+ * @param[out] s_out     arc length of the closest point
+ *
+ * @return     distance to the closest point, or -1 if none within max_dist
+ */
+float path_index_nearest(const path_index_t* idx, const path_t* p,
+                         float x, float y, float z,
+                         float s_min, float s_max, float max_dist, float* s_out);
+
+// release index storage
+void path_index_free(path_index_t* idx);
+
+#endif // PATH_INDEX_H
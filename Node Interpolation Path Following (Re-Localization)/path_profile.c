@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "path_profile.h"
+
+#define BISECT_ITERATIONS 32
+#define BISECT_TOL_V 1e-4f      // speed searches stop once bracketed this tightly (m/s)
+#define SMOOTH_TURN_RAD 0.26f   // turns under ~15 degrees are samples of a curve, not corners
+#define LEG_SPEED_RATIO 0.9f    // a curve sample stays in its leg while within 10% of its speed limit
+
+
+// duration of a symmetric S-curve speed change of magnitude dv
+static float scurve_time(float dv, const path_limits_t* lim)
+{
+    dv = fabsf(dv);
+    if (dv * lim->jmax >= lim->amax * lim->amax) {
+        return dv / lim->amax + lim->amax / lim->jmax;
+    }
+    return 2.0f * sqrtf(dv / lim->jmax);
+}
+
+// distance covered while changing speed from v0 to v1
+static float scurve_dist(float v0, float v1, const path_limits_t* lim)
+{
+    return 0.5f * (v0 + v1) * scurve_time(v1 - v0, lim);
+}
+
+/*
+ * state after time tau into an S-curve from v0 to v1: jerk up to the peak
+ * acceleration, hold it if the change is large enough, then jerk back to 0
+ */
+static void scurve_eval(float v0, float v1, const path_limits_t* lim, float tau,
+                        float* s, float* v, float* a)
+{
+    float sgn = (v1 >= v0) ? 1.0f : -1.0f;
+    float dv = fabsf(v1 - v0);
+    float j = lim->jmax;
+    float ap, tj, ta;
+
+    if (dv * j >= lim->amax * lim->amax) {
+        ap = lim->amax;
+        tj = ap / j;
+        ta = dv / ap - tj;
+    } else {
+        ap = sqrtf(dv * j);
+        tj = ap / j;
+        ta = 0.0f;
+    }
+
+    if (tau <= 0.0f) {
+        *s = 0.0f; *v = v0; *a = 0.0f;
+        return;
+    }
+    if (tau < tj) {
+        *a = sgn * j * tau;
+        *v = v0 + sgn * j * tau * tau / 2.0f;
+        *s = v0 * tau + sgn * j * tau * tau * tau / 6.0f;
+        return;
+    }
+
+    float v_1 = v0 + sgn * j * tj * tj / 2.0f;
+    float s_1 = v0 * tj + sgn * j * tj * tj * tj / 6.0f;
+    tau -= tj;
+    if (tau < ta) {
+        *a = sgn * ap;
+        *v = v_1 + sgn * ap * tau;
+        *s = s_1 + v_1 * tau + sgn * ap * tau * tau / 2.0f;
+        return;
+    }
+
+    float v_2 = v_1 + sgn * ap * ta;
+    float s_2 = s_1 + v_1 * ta + sgn * ap * ta * ta / 2.0f;
+    tau -= ta;
+    if (tau > tj) tau = tj;
+    *a = sgn * (ap - j * tau);
+    *v = v_2 + sgn * (ap * tau - j * tau * tau / 2.0f);
+    *s = s_2 + v_2 * tau + sgn * (ap * tau * tau / 2.0f - j * tau * tau * tau / 6.0f);
+}
+
+// highest speed reachable from v0 within distance len
+static float reachable_speed(float v0, float len, const path_limits_t* lim)
+{
+    if (scurve_dist(v0, lim->vmax, lim) <= len) return lim->vmax;
+
+    float lo = v0, hi = lim->vmax;
+    while (hi - lo > BISECT_TOL_V) {
+        float mid = 0.5f * (lo + hi);
+        if (scurve_dist(v0, mid, lim) <= len) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * max speed through node i: the junction deviation limit for the corner
+ * between segments i-1 and i, and the centripetal limit of the curve the two
+ * segments sample. Also reports the turn angle at the node.
+ */
+static float node_limit(const path_t* p, int i, const path_limits_t* lim, float* turn)
+{
+    const path_segment_t* a = &p->seg[i-1];
+    const path_segment_t* b = &p->seg[i];
+
+    float dot = a->ux * b->ux + a->uy * b->uy + a->uz * b->uz;
+    if (dot > 1.0f) dot = 1.0f;
+    if (dot < -1.0f) dot = -1.0f;
+    *turn = acosf(dot);
+
+    // cosine of the angle between the reversed incoming and the outgoing direction
+    float cos_theta = -dot;
+    if (cos_theta > 0.999999f) return 0.0f;     // full reversal
+    if (cos_theta < -0.999999f) return lim->vmax; // straight through
+
+    float sin_half = sqrtf(0.5f * (1.0f - cos_theta));
+    float v = sqrtf(lim->amax * lim->corner_deviation * sin_half / (1.0f - sin_half));
+
+    float radius = 0.5f * (a->len + b->len) / *turn;
+    float v_curve = sqrtf(lim->amax * radius);
+    if (v_curve < v) v = v_curve;
+    return (v < lim->vmax) ? v : lim->vmax;
+}
+
+// arc length at node i
+static float node_s(const path_t* p, int i)
+{
+    return (i < p->n_nodes - 1) ? p->seg[i].s0 : p->length;
+}
+
+/*
+ * split the path into legs. Sharp corners always end a leg. Gentle turns
+ * are samples of a curve and stay inside the current leg while their speed
+ * limit is close to the one the leg started with, so a densely sampled
+ * curve or a long straight is planned as one S-curve instead of stopping
+ * the acceleration at every sample. Nodes with an action always end a leg
+ * too. Returns the number of legs, bound[] gets the node index where each
+ * leg starts plus the final node, cap[] the speed limit inside each leg.
+ */
+static int split_legs(const path_t* p, const path_limits_t* lim, const float* node_v,
+                      const float* turn, const char* stop, int* bound, float* cap)
+{
+    int n_legs = 0;
+    float ref = -1.0f;      // limit of the first node inside the current leg
+    cap[0] = lim->vmax;
+    bound[0] = 0;
+
+    for (int i = 1; i < p->n_nodes - 1; ++i) {
+        int smooth = turn[i] < SMOOTH_TURN_RAD && !stop[i];
+        if (smooth && (ref < 0.0f ||
+                       (node_v[i] >= LEG_SPEED_RATIO * ref && LEG_SPEED_RATIO * node_v[i] <= ref))) {
+            if (ref < 0.0f) ref = node_v[i];
+            if (node_v[i] < cap[n_legs]) cap[n_legs] = node_v[i];
+            continue;
+        }
+        bound[++n_legs] = i;
+        cap[n_legs] = lim->vmax;
+        ref = -1.0f;
+    }
+    bound[++n_legs] = p->n_nodes - 1;
+    return n_legs;
+}
+
+
+int path_profile_plan(path_t* p, const path_limits_t* lim)
+{
+    if (p->n_nodes < 2 || !p->seg || p->compiled) return -1;
+    if (lim->vmax <= 0.0f || lim->amax <= 0.0f || lim->jmax <= 0.0f ||
+        lim->corner_deviation < 0.0f) {
+        fprintf(stderr, "ERROR: invalid path limits\n");
+        return -1;
+    }
+
+    int n = p->n_nodes;
+    float* node_v = malloc(n * sizeof(float));
+    float* turn = malloc(n * sizeof(float));
+    float* cap = malloc(n * sizeof(float));
+    float* v = malloc(n * sizeof(float));
+    int* bound = malloc(n * sizeof(int));
+    char* stop = calloc(n, 1);
+    int ret = -1;
+    if (!node_v || !turn || !cap || !v || !bound || !stop) goto done;
+
+    // the vehicle comes to rest at every action
+    for (int k = 0; k < p->n_actions; ++k) stop[p->action[k].node] = 1;
+    for (int i = 1; i < n - 1; ++i) {
+        node_v[i] = node_limit(p, i, lim, &turn[i]);
+        if (stop[i]) node_v[i] = 0.0f;
+    }
+    int n_legs = split_legs(p, lim, node_v, turn, stop, bound, cap);
+
+    // limit at each leg boundary, start and end at rest. The speed inside a
+    // leg never drops below its ends, so they must respect both legs' caps.
+    v[0] = 0.0f;
+    v[n_legs] = 0.0f;
+    for (int k = 1; k < n_legs; ++k) {
+        v[k] = node_v[bound[k]];
+        if (v[k] > cap[k-1]) v[k] = cap[k-1];
+        if (v[k] > cap[k]) v[k] = cap[k];
+    }
+
+    // forward pass for acceleration, backward pass for braking. Only search
+    // for the reachable speed when the limit at the far end is not reachable
+    // outright.
+    for (int k = 0; k < n_legs; ++k) {
+        float len = node_s(p, bound[k+1]) - node_s(p, bound[k]);
+        if (v[k+1] <= v[k] || scurve_dist(v[k], v[k+1], lim) <= len) continue;
+        float r = reachable_speed(v[k], len, lim);
+        if (v[k+1] > r) v[k+1] = r;
+    }
+    for (int k = n_legs; k > 0; --k) {
+        float len = node_s(p, bound[k]) - node_s(p, bound[k-1]);
+        if (v[k-1] <= v[k] || scurve_dist(v[k], v[k-1], lim) <= len) continue;
+        float r = reachable_speed(v[k], len, lim);
+        if (v[k-1] > r) v[k-1] = r;
+    }
+
+    size_t bytes = n_legs * sizeof(path_leg_t);
+    path_leg_t* legs = p->arena ? arena_realloc(p->arena, p->leg, bytes) : realloc(p->leg, bytes);
+    if (!legs) goto done;
+    p->leg = legs;
+    p->n_legs = n_legs;
+
+    // highest cruise speed each leg can fit, then its timing
+    float t = 0.0f;
+    for (int k = 0; k < n_legs; ++k) {
+        path_leg_t* g = &legs[k];
+        g->s0 = node_s(p, bound[k]);
+        g->len = node_s(p, bound[k+1]) - g->s0;
+
+        float lo = (v[k] > v[k+1]) ? v[k] : v[k+1];
+        float hi = cap[k];
+        if (scurve_dist(v[k], hi, lim) + scurve_dist(hi, v[k+1], lim) <= g->len) {
+            lo = hi;
+        } else {
+            while (hi - lo > BISECT_TOL_V) {
+                float mid = 0.5f * (lo + hi);
+                if (scurve_dist(v[k], mid, lim) + scurve_dist(mid, v[k+1], lim) <= g->len) lo = mid;
+                else hi = mid;
+            }
+        }
+
+        g->t0 = t;
+        g->v_in = v[k];
+        g->v_cruise = lo;
+        g->v_out = v[k+1];
+        g->t_acc = scurve_time(lo - v[k], lim);
+        g->t_dec = scurve_time(lo - v[k+1], lim);
+        float d_cruise = g->len - scurve_dist(v[k], lo, lim) - scurve_dist(lo, v[k+1], lim);
+        g->t_cruise = (lo > 1e-6f && d_cruise > 0.0f) ? d_cruise / lo : 0.0f;
+        t += g->t_acc + g->t_cruise + g->t_dec;
+
+        for (int i = bound[k]; i < bound[k+1]; ++i) p->seg[i].leg = k;
+    }
+    p->duration = t;
+
+    // actions are in node order and every action node starts a leg or ends the path
+    for (int a = 0, k = 0; a < p->n_actions; ++a) {
+        while (k < n_legs && bound[k] < p->action[a].node) k++;
+        p->action[a].t = (k < n_legs) ? legs[k].t0 : t;
+    }
+    ret = 0;
+
+done:
+    free(node_v);
+    free(turn);
+    free(cap);
+    free(v);
+    free(bound);
+    free(stop);
+    return ret;
+}
+
+
+// find the leg flown at time t, same idea as path_find_segment()
+static int find_leg_by_time(const path_t* p, float t, int hint)
+{
+    int last = p->n_legs - 1;
+
+    if (hint >= 0 && hint <= last && t >= p->leg[hint].t0) {
+        int k = hint;
+        while (k < last && t >= p->leg[k+1].t0) k++;
+        return k;
+    }
+
+    int lo = 0, hi = last;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (p->leg[mid].t0 <= t) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+
+// arc length, speed and acceleration tau seconds into leg g
+static void leg_state(const path_leg_t* g, const path_limits_t* lim, float tau,
+                      float* s, float* v, float* a)
+{
+    if (tau < g->t_acc) {
+        scurve_eval(g->v_in, g->v_cruise, lim, tau, s, v, a);
+    } else if (tau < g->t_acc + g->t_cruise) {
+        *s = scurve_dist(g->v_in, g->v_cruise, lim) + g->v_cruise * (tau - g->t_acc);
+        *v = g->v_cruise;
+        *a = 0.0f;
+    } else {
+        float s_dec = g->len - scurve_dist(g->v_cruise, g->v_out, lim);
+        scurve_eval(g->v_cruise, g->v_out, lim, tau - g->t_acc - g->t_cruise, s, v, a);
+        *s += s_dec;
+    }
+    if (*s > g->len) *s = g->len;
+}
+
+
+int path_eval_at_time(const path_t* p, const path_limits_t* lim, float t, int hint, path_setpoint_t* sp)
+{
+    memset(sp, 0, sizeof(*sp));
+    if (p->n_nodes < 2 || p->n_legs < 1) return 0;
+
+    if (t >= p->duration) {
+        int last = p->n_nodes - 1;
+        sp->x = p->x[last];
+        sp->y = p->y[last];
+        sp->z = p->z[last];
+        return last - 1;
+    }
+    if (t < 0.0f) t = 0.0f;
+
+    int valid_hint = (hint >= 0 && hint < p->n_nodes - 1);
+    int k = find_leg_by_time(p, t, valid_hint ? p->seg[hint].leg : -1);
+    const path_leg_t* g = &p->leg[k];
+    float s, v, a;
+    leg_state(g, lim, t - g->t0, &s, &v, &a);
+    s += g->s0;
+
+    int i = path_find_segment(p, s, valid_hint ? hint : -1);
+    const path_segment_t* seg = &p->seg[i];
+    float d = s - seg->s0;
+    if (d > seg->len) d = seg->len;
+
+    sp->x = p->x[i] + seg->ux * d;
+    sp->y = p->y[i] + seg->uy * d;
+    sp->z = p->z[i] + seg->uz * d;
+    sp->vx = seg->ux * v;
+    sp->vy = seg->uy * v;
+    sp->vz = seg->uz * v;
+    sp->ax = seg->ux * a;
+    sp->ay = seg->uy * a;
+    sp->az = seg->uz * a;
+    return i;
+}
+
+
+float path_time_at_s(const path_t* p, const path_limits_t* lim, float s, int hint)
+{
+    if (p->n_nodes < 2 || p->n_legs < 1 || s <= 0.0f) return 0.0f;
+    if (s >= p->length) return p->duration;
+
+    const path_leg_t* g = &p->leg[p->seg[path_find_segment(p, s, hint)].leg];
+    float target = s - g->s0;
+    float lo = 0.0f;
+    float hi = g->t_acc + g->t_cruise + g->t_dec;
+
+    // arc length is monotonic in time within a leg
+    for (int k = 0; k < BISECT_ITERATIONS; ++k) {
+        float mid = 0.5f * (lo + hi);
+        float sm, vm, am;
+        leg_state(g, lim, mid, &sm, &vm, &am);
+        if (sm < target) lo = mid;
+        else hi = mid;
+    }
+    return g->t0 + 0.5f * (lo + hi);
+}
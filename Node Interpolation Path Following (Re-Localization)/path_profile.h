@@ -0,0 +1,60 @@
+#ifndef PATH_PROFILE_H
+#define PATH_PROFILE_H
+
+#include "path_segments.h"
+
+/**
+ * Jerk-limited velocity planning along a segment path.
+ *
+ * Segments are grouped into legs: sharp corners end a leg, runs of gentle
+ * turns with similar speed limits (straights, densely sampled curves) share
+ * one. Each leg is flown as an S-curve speed-up from v_in to v_cruise, a
+ * cruise, and an S-curve slow-down to v_out. Node speeds are limited by the
+ * corner angle (junction deviation), by the curvature the neighbouring
+ * segments sample (amax used as lateral acceleration) and by what the
+ * neighbouring legs can reach under amax/jmax. The profile is then
+ * evaluated by time.
+ */
+
+typedef struct path_limits_t {
+    float vmax;                 // max speed along the path (m/s)
+    float amax;                 // max tangential acceleration (m/s^2)
+    float jmax;                 // max tangential jerk (m/s^3)
+    float corner_deviation;     // junction deviation used for corner speed (m)
+} path_limits_t;
+
+
+/**
+ * @brief      plan node speeds and per-segment timing for the whole path
+ *
+ *             The path starts and ends at rest, and stops at every action.
+ *             Fills p->leg, the leg index of every segment, p->duration and
+ *             the time of every action.
+ *
+ * @return     0 on success, -1 on invalid limits or path, or if the path was
+ *             loaded read-only from a compiled file
+ */
+int path_profile_plan(path_t* p, const path_limits_t* lim);
+
+/**
+ * @brief      evaluate position, velocity and acceleration at time t
+ *
+ *             t is clamped to [0, p->duration]. Velocity and acceleration are
+ *             along the segment direction, ready for use as feed-forward.
+ *
+ * @param[in]  hint  previous return value, or -1
+ *
+ * @return     segment index used, suitable as the next hint
+ */
+int path_eval_at_time(const path_t* p, const path_limits_t* lim, float t, int hint, path_setpoint_t* sp);
+
+/**
+ * @brief      time at which the profile reaches arc length s
+ *
+ * @param[in]  hint  segment hint for the arc length lookup, or -1
+ *
+ * @return     time in [0, p->duration]
+ */
+float path_time_at_s(const path_t* p, const path_limits_t* lim, float s, int hint);
+
+#endif // PATH_PROFILE_H
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "path_segments.h"
+#include "csv_reader.h"
+#include "tag_map.h"
+
+#define INITIAL_NODE_CAP 64
+
+
+// realloc from the path's arena when it has one
+static void* path_realloc(path_t* p, void* ptr, size_t size)
+{
+    if (p->arena) return arena_realloc(p->arena, ptr, size);
+    return realloc(ptr, size);
+}
+
+
+int path_add_node(path_t* p, float x, float y, float z)
+{
+    if (p->compiled) return -1;
+    if (p->n_nodes >= p->cap_nodes) {
+        int cap = p->cap_nodes ? p->cap_nodes * 2 : INITIAL_NODE_CAP;
+        float* nx = path_realloc(p, p->x, cap * sizeof(float));
+        if (!nx) return -1;
+        p->x = nx;
+        float* ny = path_realloc(p, p->y, cap * sizeof(float));
+        if (!ny) return -1;
+        p->y = ny;
+        float* nz = path_realloc(p, p->z, cap * sizeof(float));
+        if (!nz) return -1;
+        p->z = nz;
+        p->cap_nodes = cap;
+    }
+    p->x[p->n_nodes] = x;
+    p->y[p->n_nodes] = y;
+    p->z[p->n_nodes] = z;
+    p->n_nodes++;
+    return 0;
+}
+
+
+// nodes with a tag id in the optional fourth column become actions
+static int load_actions(path_t* p, const float* tag_col, const char* file)
+{
+    int n = 0;
+    for (int i = 0; i < p->n_nodes; ++i) {
+        if (!isnan(tag_col[i])) n++;
+    }
+    if (n == 0) return 0;
+
+    p->action = path_realloc(p, NULL, n * sizeof(path_action_t));
+    if (!p->action) return -1;
+    for (int i = 0; i < p->n_nodes; ++i) {
+        if (isnan(tag_col[i])) continue;
+        int id;
+        if (tag_map_parse_id(tag_col[i], &id)) {
+            fprintf(stderr, "ERROR: %s node %d: tag id %g is not a valid id\n", file, i + 1, (double)tag_col[i]);
+            return -1;
+        }
+        path_action_t* a = &p->action[p->n_actions++];
+        memset(a, 0, sizeof(*a));
+        a->node = i;
+        a->tag_id = id;
+    }
+    return 0;
+}
+
+
+int path_load_csv(path_t* p, const char* file)
+{
+    csv_table_t t;
+    path_free(p);
+    if (csv_load(&t, file, 3, 4, p->arena)) return -1;
+
+    // the parsed columns become the node arrays as they are
+    p->n_nodes = t.n_rows;
+    p->cap_nodes = t.cap_rows;
+    p->x = csv_take_col(&t, 0);
+    p->y = csv_take_col(&t, 1);
+    p->z = csv_take_col(&t, 2);
+    int ret = load_actions(p, t.col[3], file);
+    csv_free(&t);
+    if (ret) return -1;
+
+    if (path_build_segments(p)) {
+        fprintf(stderr, "ERROR: %s must contain at least 2 nodes\n", file);
+        return -1;
+    }
+    printf("Loaded %d path nodes, %.1fm long\n", p->n_nodes, (double)p->length);
+    if (p->n_actions) printf("  with %d relocalization stops\n", p->n_actions);
+    return 0;
+}
+
+
+int path_build_segments(path_t* p)
+{
+    if (p->n_nodes < 2 || p->compiled) return -1;
+
+    path_segment_t* seg = path_realloc(p, p->seg, (p->n_nodes - 1) * sizeof(path_segment_t));
+    if (!seg) return -1;
+    p->seg = seg;
+
+    float s = 0.0f;
+    for (int i = 0; i < p->n_nodes - 1; ++i) {
+        float dx = p->x[i+1] - p->x[i];
+        float dy = p->y[i+1] - p->y[i];
+        float dz = p->z[i+1] - p->z[i];
+        float len = sqrtf(dx*dx + dy*dy + dz*dz);
+
+        memset(&seg[i], 0, sizeof(path_segment_t));
+        seg[i].s0 = s;
+        seg[i].len = len;
+        if (len > 1e-6f) {
+            seg[i].ux = dx / len;
+            seg[i].uy = dy / len;
+            seg[i].uz = dz / len;
+        }
+        s += len;
+    }
+    p->length = s;
+    for (int k = 0; k < p->n_actions; ++k) {
+        int i = p->action[k].node;
+        p->action[k].s = (i < p->n_nodes - 1) ? seg[i].s0 : s;
+    }
+    p->duration = 0.0f;
+    p->n_legs = 0;
+    return 0;
+}
+
+
+int path_find_segment(const path_t* p, float s, int hint)
+{
+    int last = p->n_nodes - 2;
+
+    if (hint >= 0 && hint <= last) {
+        // walk forward from the hint, common case while flying the path
+        int i = hint;
+        while (i < last && s >= p->seg[i].s0 + p->seg[i].len) i++;
+        if (s >= p->seg[i].s0) return i;
+    }
+
+    // binary search for the last segment starting at or before s
+    int lo = 0, hi = last;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (p->seg[mid].s0 <= s) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+
+void path_free(path_t* p)
+{
+    arena_t* arena = p->arena;
+    if (p->compiled) {
+        if (!arena) free(p->compiled);
+    } else if (!arena) {
+        free(p->x);
+        free(p->y);
+        free(p->z);
+        free(p->seg);
+        free(p->leg);
+        free(p->action);
+    }
+    memset(p, 0, sizeof(*p));
+    p->arena = arena;
+}
@@ -0,0 +1,126 @@
+#ifndef PATH_SEGMENTS_H
+#define PATH_SEGMENTS_H
+
+#include "arena.h"
+
+/**
+ * Segment-based representation of a node-interpolated path.
+ *
+ * Only the CSV nodes and a little metadata per segment are kept in memory.
+ * Setpoints are evaluated on demand from the arc length along the path, so
+ * there is no precomputed sample array and no limit on path length.
+ */
+
+typedef struct path_segment_t {
+    float s0;           // arc length at the start of the segment (m)
+    float len;          // length of the segment (m)
+    float ux, uy, uz;   // unit direction from node i to node i+1
+    int leg;            // profile leg the segment belongs to, set by path_profile_plan()
+} path_segment_t;
+
+/*
+ * Run of consecutive segments flown as one S-curve speed-up from v_in to
+ * v_cruise, a cruise, and an S-curve slow-down to v_out. Filled by
+ * path_profile_plan(), see path_profile.h.
+ */
+typedef struct path_leg_t {
+    float s0;           // arc length at the start of the leg (m)
+    float len;          // length of the leg (m)
+    float t0;           // time at the start of the leg (s)
+    float v_in;         // speed entering the leg (m/s)
+    float v_cruise;     // peak speed inside the leg (m/s)
+    float v_out;        // speed leaving the leg (m/s)
+    float t_acc;        // duration of the v_in -> v_cruise S-curve (s)
+    float t_cruise;     // duration at v_cruise (s)
+    float t_dec;        // duration of the v_cruise -> v_out S-curve (s)
+} path_leg_t;
+
+/*
+ * Relocalization stop at a node: the profile comes to rest there and the
+ * sender turns to face the tag until it is confirmed, then carries on.
+ */
+typedef struct path_action_t {
+    int node;           // node the vehicle stops at
+    int tag_id;         // tag to face and confirm
+    float s;            // arc length of the node, set by path_build_segments()
+    float t;            // profile time the vehicle is at rest there, set by path_profile_plan()
+} path_action_t;
+
+typedef struct path_t {
+    int n_nodes;
+    int cap_nodes;
+    float* x;
+    float* y;
+    float* z;
+    path_segment_t* seg;    // n_nodes-1 entries
+    path_leg_t* leg;        // n_legs entries, NULL until planned
+    int n_legs;
+    path_action_t* action;  // n_actions entries in node order, NULL if none
+    int n_actions;
+    float length;           // total arc length (m)
+    float duration;         // total time to fly the path (s), 0 until planned
+    void* compiled;         // compiled file backing the arrays read-only, see path_binary.h
+    arena_t* arena;         // if set, arrays come from this arena and are released with it
+} path_t;
+
+// setpoint evaluated along the path, local NED
+typedef struct path_setpoint_t {
+    float x, y, z;
+    float vx, vy, vz;
+    float ax, ay, az;
+    float yaw;
+} path_setpoint_t;
+
+
+/**
+ * @brief      load x,y,z nodes from a CSV file, one node per line
+ *
+ *             A header row, comments and blank lines are skipped, any other
+ *             line that is not three numbers fails the load with its line
+ *             number. An optional fourth column holds a tag id to stop and
+ *             relocalize on at that node. Segment metadata is built on
+ *             success.
+ *
+ * @return     0 on success, -1 on failure
+ */
+int path_load_csv(path_t* p, const char* file);
+
+/**
+ * @brief      append a node, growing the node storage as needed
+ *
+ * @return     0 on success, -1 on allocation failure or if the path was
+ *             loaded read-only from a compiled file
+ */
+int path_add_node(path_t* p, float x, float y, float z);
+
+/**
+ * @brief      (re)build the per-segment metadata from the node list
+ *
+ *             Also sets the arc length of every action.
+ *             Zero-length segments (repeated nodes) are kept with len=0 and
+ *             are skipped over naturally by the arc length lookup.
+ *
+ * @return     0 on success, -1 if there are fewer than 2 nodes
+ */
+int path_build_segments(path_t* p);
+
+/**
+ * @brief      find the segment containing arc length s
+ *
+ * @param[in]  hint  segment to start searching from, pass the previous
+ *                   result when s increases monotonically to make the lookup
+ *                   O(1) per tick. Pass -1 for a binary search.
+ *
+ * @return     segment index in [0, n_nodes-2]
+ */
+int path_find_segment(const path_t* p, float s, int hint);
+
+/**
+ * @brief      release node and segment storage
+ *
+ *             Storage from an arena is left to arena_release(). The arena
+ *             pointer itself is kept so the path can be loaded again.
+ */
+void path_free(path_t* p);
+
+#endif // PATH_SEGMENTS_H
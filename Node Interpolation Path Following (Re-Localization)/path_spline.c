@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "path_spline.h"
+
+#define MIN_NODE_GAP 1e-4f      // control nodes closer than this are merged
+#define MIN_STEP_U 1e-4f        // smallest parameter step, bounds the samples per span
+#define FLAT_CURVATURE 1e-6f    // curvature (1/m) below which a stretch is straight
+#define STEP_REFINE 8           // attempts to fit a step to the curvature it spans
+
+typedef float vf __attribute__((vector_size(SPLINE_LANES * sizeof(float))));
+
+// one span as p(u) = ((a*u + b)*u + c)*u + d per axis, u in [0,1]
+typedef struct span_t {
+    float a[3], b[3], c[3], d[3];
+    int first;              // index of the span's first sample parameter
+    int n;                  // samples taken from this span
+} span_t;
+
+
+static float dist3(const float* p, const float* q)
+{
+    float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+/*
+ * centripetal Catmull-Rom through p1 and p2, converted from its Hermite form
+ * with the non-uniform tangents rescaled to u in [0,1]
+ */
+static void catmull_rom_span(span_t* sp, const float* p0, const float* p1,
+                             const float* p2, const float* p3)
+{
+    float d01 = sqrtf(dist3(p0, p1)), d12 = sqrtf(dist3(p1, p2)), d23 = sqrtf(dist3(p2, p3));
+    if (d01 < MIN_NODE_GAP) d01 = MIN_NODE_GAP;
+    if (d12 < MIN_NODE_GAP) d12 = MIN_NODE_GAP;
+    if (d23 < MIN_NODE_GAP) d23 = MIN_NODE_GAP;
+
+    for (int k = 0; k < 3; ++k) {
+        float m1 = (p1[k] - p0[k]) / d01 - (p2[k] - p0[k]) / (d01 + d12) + (p2[k] - p1[k]) / d12;
+        float m2 = (p2[k] - p1[k]) / d12 - (p3[k] - p1[k]) / (d12 + d23) + (p3[k] - p2[k]) / d23;
+        m1 *= d12;
+        m2 *= d12;
+        sp->a[k] = 2.0f * p1[k] - 2.0f * p2[k] + m1 + m2;
+        sp->b[k] = -3.0f * p1[k] + 3.0f * p2[k] - 2.0f * m1 - m2;
+        sp->c[k] = m1;
+        sp->d[k] = p1[k];
+    }
+}
+
+static void bspline_span(span_t* sp, const float* p0, const float* p1,
+                         const float* p2, const float* p3)
+{
+    for (int k = 0; k < 3; ++k) {
+        sp->a[k] = (-p0[k] + 3.0f * p1[k] - 3.0f * p2[k] + p3[k]) / 6.0f;
+        sp->b[k] = (3.0f * p0[k] - 6.0f * p1[k] + 3.0f * p2[k]) / 6.0f;
+        sp->c[k] = (-3.0f * p0[k] + 3.0f * p2[k]) / 6.0f;
+        sp->d[k] = (p0[k] + 4.0f * p1[k] + p2[k]) / 6.0f;
+    }
+}
+
+// curvature of the span at u, and |dp/du| to turn distances into parameter steps
+static float span_curvature(const span_t* sp, float u, float* speed)
+{
+    float d1[3], d2[3];
+    for (int k = 0; k < 3; ++k) {
+        d1[k] = (3.0f * sp->a[k] * u + 2.0f * sp->b[k]) * u + sp->c[k];
+        d2[k] = 6.0f * sp->a[k] * u + 2.0f * sp->b[k];
+    }
+    float cx = d1[1] * d2[2] - d1[2] * d2[1];
+    float cy = d1[2] * d2[0] - d1[0] * d2[2];
+    float cz = d1[0] * d2[1] - d1[1] * d2[0];
+    float n = sqrtf(d1[0]*d1[0] + d1[1]*d1[1] + d1[2]*d1[2]);
+    *speed = n;
+    if (n < 1e-6f) return 0.0f;
+    return sqrtf(cx*cx + cy*cy + cz*cz) / (n * n * n);
+}
+
+/*
+ * longest chord allowed at curvature k: the chord tolerance, relaxed to one
+ * setpoint period of travel at the speed the curve allows
+ */
+static float chord_length(float k, const path_sampling_t* s)
+{
+    if (k < FLAT_CURVATURE) return INFINITY;
+    float chord = sqrtf(8.0f * s->chord_tol / k);
+    float v = sqrtf(s->amax / k);
+    if (v > s->vmax) v = s->vmax;
+    float tick = v / s->rate_hz;
+    return (chord > tick) ? chord : tick;
+}
+
+/*
+ * append the sample parameters of one span to u, starting with u = 0. Each
+ * step is sized for the highest curvature at its start, middle and end so
+ * it does not run past the start of a turn.
+ */
+static int span_params(span_t* sp, const path_sampling_t* s, float** u, int* n, int* cap)
+{
+    sp->first = *n;
+    float t = 0.0f;
+    while (t < 1.0f) {
+        if (*n + SPLINE_LANES >= *cap) {
+            int grown = *cap * 2;
+            float* tmp = realloc(*u, grown * sizeof(float));
+            if (!tmp) return -1;
+            *u = tmp;
+            *cap = grown;
+        }
+        (*u)[(*n)++] = t;
+
+        float du = 1.0f - t;
+        for (int it = 0; it < STEP_REFINE; ++it) {
+            float v0, v1, v2;
+            float k = span_curvature(sp, t, &v0);
+            float k1 = span_curvature(sp, t + 0.5f * du, &v1);
+            float k2 = span_curvature(sp, t + du, &v2);
+            if (k1 > k) k = k1;
+            if (k2 > k) k = k2;
+            if (v1 > v0) v0 = v1;
+            if (v2 > v0) v0 = v2;
+
+            float step = chord_length(k, s) / v0;
+            if (step >= du) break;
+            du = (step > MIN_STEP_U) ? step : MIN_STEP_U;
+        }
+        t += du;
+        if (t > 1.0f - MIN_STEP_U) break;
+    }
+    sp->n = *n - sp->first;
+    return 0;
+}
+
+/*
+ * write the samples of one span starting at output index i. Parameters are
+ * loaded and positions stored as whole vectors, so up to SPLINE_LANES-1
+ * values past the span are written and then overwritten by the next span
+ * or left in the padding.
+ */
+static void span_sample(const span_t* sp, const float* u, float* x, float* y, float* z, int i)
+{
+    float* out[3] = { x + i, y + i, z + i };
+    u += sp->first;
+
+    for (int k = 0; k < sp->n; k += SPLINE_LANES) {
+        vf t;
+        memcpy(&t, u + k, sizeof(t));
+        for (int a = 0; a < 3; ++a) {
+            vf v = ((sp->a[a] * t + sp->b[a]) * t + sp->c[a]) * t + sp->d[a];
+            memcpy(out[a] + k, &v, sizeof(v));
+        }
+    }
+}
+
+// control node i with the ends extended as the spline type needs
+static const float* ctrl_node(const float (*pts)[3], int n, int i, float (*ext)[3])
+{
+    if (i < 0) return ext[0];
+    if (i >= n) return ext[1];
+    return pts[i];
+}
+
+
+int path_spline_expand(path_t* out, const path_t* ctrl, path_spline_t type, const path_sampling_t* s)
+{
+    if (ctrl->n_nodes < 2 || s->chord_tol <= 0.0f || s->vmax <= 0.0f ||
+        s->amax <= 0.0f || s->rate_hz <= 0.0f) return -1;
+
+    // gather control points, dropping repeats that would make a span degenerate
+    float (*pts)[3] = malloc(ctrl->n_nodes * sizeof(*pts));
+    int* pt_of = malloc(ctrl->n_nodes * sizeof(int));  // control point each node became
+    if (!pts || !pt_of) {
+        free(pts);
+        free(pt_of);
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < ctrl->n_nodes; ++i) {
+        float p[3] = { ctrl->x[i], ctrl->y[i], ctrl->z[i] };
+        if (n == 0 || dist3(pts[n-1], p) >= MIN_NODE_GAP) memcpy(pts[n++], p, sizeof(p));
+        pt_of[i] = n - 1;
+    }
+    if (n < 2) {
+        free(pts);
+        free(pt_of);
+        return -1;
+    }
+
+    int n_spans = 0;
+    float ext[2][3];
+    if (type == PATH_SPLINE_CATMULL_ROM) {
+        // mirror the neighbours so the end spans keep their direction
+        n_spans = n - 1;
+        for (int k = 0; k < 3; ++k) {
+            ext[0][k] = 2.0f * pts[0][k] - pts[1][k];
+            ext[1][k] = 2.0f * pts[n-1][k] - pts[n-2][k];
+        }
+    } else if (type == PATH_SPLINE_BSPLINE) {
+        // triple the end points so the curve starts and ends on them
+        n_spans = n + 1;
+        memcpy(ext[0], pts[0], sizeof(ext[0]));
+        memcpy(ext[1], pts[n-1], sizeof(ext[1]));
+    } else {
+        // linear: a span per leg, each sampled once at its start
+        n_spans = n - 1;
+    }
+
+    span_t* spans = malloc(n_spans * sizeof(span_t));
+    int u_cap = 64;
+    float* u = malloc(u_cap * sizeof(float));
+    int n_u = 0;
+    if (!spans || !u) goto fail;
+
+    for (int i = 0; i < n_spans; ++i) {
+        span_t* sp = &spans[i];
+        if (type == PATH_SPLINE_CATMULL_ROM) {
+            catmull_rom_span(sp, ctrl_node(pts, n, i-1, ext), pts[i], pts[i+1], ctrl_node(pts, n, i+2, ext));
+        } else if (type == PATH_SPLINE_BSPLINE) {
+            bspline_span(sp, ctrl_node(pts, n, i-2, ext), ctrl_node(pts, n, i-1, ext),
+                         ctrl_node(pts, n, i, ext), ctrl_node(pts, n, i+1, ext));
+        } else {
+            for (int k = 0; k < 3; ++k) {
+                sp->a[k] = sp->b[k] = 0.0f;
+                sp->c[k] = pts[i+1][k] - pts[i][k];
+                sp->d[k] = pts[i][k];
+            }
+        }
+        if (span_params(sp, s, &u, &n_u, &u_cap)) goto fail;
+    }
+    // whole vector loads read past the last parameter
+    memset(u + n_u, 0, SPLINE_LANES * sizeof(float));
+    long total = n_u + 1;
+
+    // room for whole vector stores past the last sample
+    int cap = (int)total + SPLINE_LANES;
+    path_free(out);
+    size_t bytes = cap * sizeof(float);
+    for (int a = 0; a < 3; ++a) {
+        float* col = out->arena ? arena_alloc(out->arena, bytes) : malloc(bytes);
+        if (!col) goto fail;
+        if (a == 0) out->x = col;
+        else if (a == 1) out->y = col;
+        else out->z = col;
+    }
+    out->cap_nodes = cap;
+
+    int i = 0;
+    for (int k = 0; k < n_spans; ++k) {
+        span_sample(&spans[k], u, out->x, out->y, out->z, i);
+        i += spans[k].n;
+    }
+    // every type ends on the last control node, place it exactly
+    out->x[i] = pts[n-1][0];
+    out->y[i] = pts[n-1][1];
+    out->z[i] = pts[n-1][2];
+    out->n_nodes = i + 1;
+
+    // actions move to the sample where their node is, or the curve passes
+    // closest for a B-spline
+    if (ctrl->n_actions) {
+        size_t action_bytes = ctrl->n_actions * sizeof(path_action_t);
+        out->action = out->arena ? arena_alloc(out->arena, action_bytes) : malloc(action_bytes);
+        if (!out->action) goto fail;
+        for (int k = 0; k < ctrl->n_actions; ++k) {
+            int j = pt_of[ctrl->action[k].node];
+            path_action_t* a = &out->action[out->n_actions++];
+            *a = ctrl->action[k];
+            if (j == 0) a->node = 0;
+            else if (j == n - 1) a->node = out->n_nodes - 1;
+            else if (type == PATH_SPLINE_BSPLINE) a->node = spans[j+1].first;
+            else a->node = spans[j].first;
+        }
+    }
+
+    free(u);
+    free(spans);
+    free(pts);
+    free(pt_of);
+    return path_build_segments(out);
+
+fail:
+    free(u);
+    free(spans);
+    free(pts);
+    free(pt_of);
+    path_free(out);
+    return -1;
+}
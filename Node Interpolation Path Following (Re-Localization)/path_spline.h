@@ -0,0 +1,61 @@
+#ifndef PATH_SPLINE_H
+#define PATH_SPLINE_H
+
+#include "path_segments.h"
+
+/**
+ * Smooth interpolation of the CSV nodes.
+ *
+ * The nodes are treated as spline control points and expanded into a dense
+ * polyline, which then goes through path_build_segments() and the velocity
+ * planner like any other path. With no sharp corners left between samples
+ * the planner no longer has to stop at every node.
+ *
+ * Samples are placed by curvature rather than at a fixed density. Flying
+ * straight between samples cuts inside the curve by c^2 * k / 8 for a chord
+ * c at curvature k, so each chord is made as long as the chord tolerance
+ * allows: straight stretches collapse to a few samples while tight turns
+ * keep full detail. Samples are never placed closer than the vehicle moves
+ * in one setpoint period at the speed the curve can be flown, since finer
+ * detail cannot be commanded anyway.
+ *
+ * Every span is turned into one cubic polynomial per axis up front. The
+ * sample positions are then evaluated SPLINE_LANES at a time with GCC
+ * vector extensions, which map onto NEON on VOXL and SSE/AVX on a host.
+ */
+
+typedef enum path_spline_t {
+    PATH_SPLINE_LINEAR,         // nodes joined by straight lines, no expansion
+    PATH_SPLINE_CATMULL_ROM,    // centripetal Catmull-Rom, passes through every node
+    PATH_SPLINE_BSPLINE         // uniform cubic B-spline, smoother, cuts inside the nodes
+} path_spline_t;
+
+typedef struct path_sampling_t {
+    float chord_tol;    // max distance between the curve and the path flown (m)
+    float vmax;         // speed limit the path is planned with (m/s)
+    float amax;         // acceleration limit, sets the speed through curves (m/s^2)
+    float rate_hz;      // samples need be no closer than one period of travel at this rate
+} path_sampling_t;
+
+#ifdef __AVX__
+#define SPLINE_LANES 8
+#else
+#define SPLINE_LANES 4
+#endif
+
+
+/**
+ * @brief      expand control nodes into a densely sampled path
+ *
+ *             Both ends of the path are kept exactly. Actions move to the
+ *             sample at their node. out is freed first and keeps its arena,
+ *             if any. Segment metadata is built on success.
+ *
+ * @param[in]  ctrl     control nodes, at least 2
+ * @param[in]  s        sampling tolerance and flight limits
+ *
+ * @return     0 on success, -1 on failure
+ */
+int path_spline_expand(path_t* out, const path_t* ctrl, path_spline_t type, const path_sampling_t* s);
+
+#endif // PATH_SPLINE_H
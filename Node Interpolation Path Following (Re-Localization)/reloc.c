@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <modal_pipe.h>
+#include <rc_math.h>
+
+#include "geometry.h"
+#include "macros.h"
+#include "reloc.h"
+#include "reloc_solve.h"
+#include "frame_filter.h"
+#include "drift_model.h"
+#include "tag_learn.h"
+#include "odom_history.h"
+
+#define TAG_DETECTION_PIPE "tag_detections"
+#define PRIOR_TIMEOUT_NS 2000000000 // history older than this no longer outvotes a lone tag
+
+static int en_debug = 0;
+static int pipe_ch = -1;
+static reloc_map_acquire_t* acquire_map = NULL;
+static reloc_map_release_t* release_map = NULL;
+
+/*
+ * Sequence lock around the published correction. The writer makes seq odd
+ * while it copies, a reader retries if seq was odd or changed under it.
+ * There is only one writer, the detection thread.
+ */
+static unsigned int seq = 0;
+static reloc_correction_t shared = { .cos_yaw = 1.0f };
+
+// tag the sender waits on at a relocalization stop, and its confirmations
+static int watch_id = -1;
+static int watch_count = 0;
+
+// smoothing, drift and the last accepted correction, only touched by the detection thread
+static frame_filter_t filter;
+static drift_model_t drift;
+static reloc_correction_t prior;
+static int have_prior = 0;
+
+// poses of tags that aren't in the map, learned while relocalized
+static tag_learn_t learned;
+static int learn_en = 0;
+static char learn_file[256];
+
+// geometry works on rc_math containers, allocated once so detections don't allocate
+static rc_matrix_t R_tag_to_cam = RC_MATRIX_INITIALIZER;
+static rc_vector_t T_tag_wrt_cam = RC_VECTOR_INITIALIZER;
+static rc_matrix_t R_tag_to_local = RC_MATRIX_INITIALIZER;
+static rc_vector_t T_tag_wrt_local = RC_VECTOR_INITIALIZER;
+
+
+static void publish(const reloc_correction_t* c)
+{
+    __atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED);
+    // the odd seq must be visible before any of the new fields, an atomic
+    // increment alone doesn't order the plain stores after it on ARM
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shared = *c;
+    __atomic_add_fetch(&seq, 1, __ATOMIC_RELEASE);
+}
+
+
+void reloc_get_correction(reloc_correction_t* c)
+{
+    unsigned int before, after;
+    do {
+        before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        *c = shared;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+
+void reloc_watch_tag(int id)
+{
+    __atomic_store_n(&watch_id, -1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&watch_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&watch_id, id, __ATOMIC_SEQ_CST);
+}
+
+
+int reloc_watch_count(void)
+{
+    return __atomic_load_n(&watch_count, __ATOMIC_SEQ_CST);
+}
+
+
+void reloc_extrapolate(const reloc_correction_t* c, int64_t now_ns, float odometer_m,
+                       reloc_correction_t* out)
+{
+    *out = *c;
+    if (c->timestamp_ns == 0) return;
+
+    float dt = (now_ns - c->timestamp_ns) * 1e-9f;
+    float dd = odometer_m - c->odometer_m;
+    if (dt < 0.0f) dt = 0.0f;
+    if (dt > RELOC_MAX_EXTRAP_S) dt = RELOC_MAX_EXTRAP_S;
+    if (dd < 0.0f) dd = 0.0f;
+    if (dd > RELOC_MAX_EXTRAP_M) dd = RELOC_MAX_EXTRAP_M;
+
+    out->x += c->drift_per_s[0] * dt + c->drift_per_m[0] * dd;
+    out->y += c->drift_per_s[1] * dt + c->drift_per_m[1] * dd;
+    out->z += c->drift_per_s[2] * dt + c->drift_per_m[2] * dd;
+    float yaw = c->yaw + c->drift_per_s[3] * dt + c->drift_per_m[3] * dd;
+    out->yaw = atan2f(sinf(yaw), cosf(yaw));
+    out->cos_yaw = cosf(out->yaw);
+    out->sin_yaw = sinf(out->yaw);
+}
+
+
+void reloc_map_to_local(const reloc_correction_t* c, float* x, float* y, float* z)
+{
+    float dx = *x - c->x;
+    float dy = *y - c->y;
+    *x =  c->cos_yaw * dx + c->sin_yaw * dy;
+    *y = -c->sin_yaw * dx + c->cos_yaw * dy;
+    *z -= c->z;
+}
+
+
+void reloc_local_to_map(const reloc_correction_t* c, float* x, float* y, float* z)
+{
+    float lx = *x, ly = *y;
+    *x = c->cos_yaw * lx - c->sin_yaw * ly + c->x;
+    *y = c->sin_yaw * lx + c->cos_yaw * ly + c->y;
+    *z += c->z;
+}
+
+
+void reloc_rotate_to_local(const reloc_correction_t* c, float* x, float* y)
+{
+    float mx = *x, my = *y;
+    *x =  c->cos_yaw * mx + c->sin_yaw * my;
+    *y = -c->sin_yaw * mx + c->cos_yaw * my;
+}
+
+
+/*
+ * Tags predicted visible from where the vehicle is. Returns -1 when there is
+ * no prediction, so every surveyed tag is accepted.
+ */
+static int expected_tags(const reloc_map_t* map)
+{
+    const int* tags;
+    if (!map->visible || map->seg < 0) return -1;
+    return tag_visibility_get(map->visible, map->seg, &tags);
+}
+
+// pose of a detected tag in local frame at the time its frame was captured
+static int tag_in_local(const tag_detection_t* d, float R[3][3], float T[3])
+{
+    for (int i = 0; i < 3; ++i) {
+        T_tag_wrt_cam.d[i] = d->T_tag_wrt_cam[i];
+        for (int j = 0; j < 3; ++j) R_tag_to_cam.d[i][j] = d->R_tag_to_cam[i][j];
+    }
+    if (geometry_calc_R_T_tag_in_local_frame(d->timestamp_ns, R_tag_to_cam, T_tag_wrt_cam,
+                                             &R_tag_to_local, &T_tag_wrt_local)) {
+        return -1;
+    }
+    for (int i = 0; i < 3; ++i) {
+        T[i] = T_tag_wrt_local.d[i];
+        for (int j = 0; j < 3; ++j) R[i][j] = R_tag_to_local.d[i][j];
+    }
+    return 0;
+}
+
+
+// local frame pose and confidence of one detection
+static int observe(const tag_detection_t* d, reloc_obs_t* o)
+{
+    float R[3][3];
+    if (tag_in_local(d, R, o->local)) return -1;
+
+    o->id = d->id;
+    o->yaw_local = atan2f(R[1][0], R[0][0]);
+    // the detection is packed, copy out before taking addresses
+    float T_cam[3], R_cam[3][3];
+    memcpy(T_cam, d->T_tag_wrt_cam, sizeof(T_cam));
+    memcpy(R_cam, d->R_tag_to_cam, sizeof(R_cam));
+    o->weight = reloc_obs_weight(T_cam, R_cam, d->size_m);
+    return 0;
+}
+
+
+/*
+ * Build the observation for one detection of a surveyed tag. The surveyed
+ * yaw is the yaw of the tag frame in the map frame, taken the same way as it
+ * is from the detection here, so the two compare directly.
+ */
+static int make_obs(const reloc_map_t* map, int n_expected, const tag_detection_t* d,
+                    const apriltag_pose_t* pose, reloc_obs_t* o)
+{
+    if (n_expected > 0 &&
+        !tag_visibility_expects(map->visible, map->seg, (int)(pose - map->tags->tags))) {
+        if (en_debug) printf("reloc tag %d not expected from segment %d, ignored\n", d->id, map->seg);
+        return -1;
+    }
+    if (observe(d, o)) return -1;
+
+    o->map[0] = pose->x;
+    o->map[1] = pose->y;
+    o->map[2] = pose->z;
+    o->yaw_map = (float)((double)pose->yaw_deg * DEG_TO_RAD);
+    return 0;
+}
+
+
+// place sightings of tags that aren't in the map with the correction of their frame
+static void learn_tags(const reloc_obs_t* o, int n, const reloc_correction_t* c)
+{
+    for (int i = 0; i < n; ++i) {
+        float p[3] = { o[i].local[0], o[i].local[1], o[i].local[2] };
+        reloc_local_to_map(c, &p[0], &p[1], &p[2]);
+        tag_learn_add(&learned, o[i].id, p, o[i].yaw_local + c->yaw, o[i].weight);
+    }
+}
+
+/*
+ * Fit, smooth and publish the correction for one frame's surveyed tags.
+ * prior is the last correction carried to this frame, NULL if it is stale.
+ * Returns 0 with the published correction in c.
+ */
+static int fuse(reloc_obs_t* obs, int n_obs, const odom_sample_t* then,
+                const reloc_correction_t* prior_now, reloc_correction_t* c)
+{
+    // drop detections the other tags or recent history disagree with
+    int n_seen = n_obs;
+    n_obs = reloc_consensus(obs, n_obs, prior_now);
+    if (en_debug && n_obs < n_seen) {
+        printf("reloc rejected %d of %d tags as inconsistent\n", n_seen - n_obs, n_seen);
+    }
+
+    float rms;
+    if (reloc_solve(obs, n_obs, c, &rms)) return -1;
+
+    int watched = __atomic_load_n(&watch_id, __ATOMIC_SEQ_CST);
+    for (int i = 0; watched >= 0 && i < n_obs; ++i) {
+        if (obs[i].id == watched) {
+            __atomic_add_fetch(&watch_count, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    c->timestamp_ns = then->timestamp_ns;
+    c->n_tags = n_obs;
+    c->odometer_m = then->odometer_m;
+    if (!prior_now) frame_filter_reset(&filter); // don't average across a jump
+    frame_filter_add(&filter, c, then->quality, c);
+    drift_model_update(&drift, c);
+    publish(c);
+    prior = *c;
+    have_prior = 1;
+
+    if (en_debug) {
+        printf("reloc %d tags yaw:%6.1fdeg x:%7.3f y:%7.3f z:%7.3f rms:%6.3fm\n", n_obs,
+               (double)c->yaw * RAD_TO_DEG, (double)c->x, (double)c->y, (double)c->z, (double)rms);
+    }
+    return 0;
+}
+
+
+// fuse every surveyed tag seen in one camera frame into one correction
+static void process_frame(const reloc_map_t* map, const tag_detection_t* d, int n)
+{
+    // nothing surveyed should be in view here, don't spend any time on the frame
+    int n_expected = expected_tags(map);
+    if (n_expected == 0 && !learn_en) return;
+
+    reloc_obs_t obs[RELOC_MAX_TAGS];
+    reloc_obs_t unknown[RELOC_MAX_TAGS];
+    int n_obs = 0;
+    int n_unknown = 0;
+    for (int i = 0; i < n; ++i) {
+        const apriltag_pose_t* pose = tag_map_find(map->tags, d[i].id);
+        if (pose) {
+            if (n_expected != 0 && n_obs < RELOC_MAX_TAGS &&
+                make_obs(map, n_expected, &d[i], pose, &obs[n_obs]) == 0) n_obs++;
+        } else if (learn_en && n_unknown < RELOC_MAX_TAGS) {
+            if (observe(&d[i], &unknown[n_unknown]) == 0) n_unknown++;
+        }
+    }
+
+    if (n_obs == 0 && n_unknown == 0) return;
+
+    // where the vehicle was when the frame was exposed, not now, so the
+    // correction lines up with the odometry it is learned against
+    odom_sample_t then = { .timestamp_ns = d[0].timestamp_ns };
+    odom_history_at(d[0].timestamp_ns, &then);
+
+    // recent history carried forward by the drift learned so far
+    int fresh = have_prior && then.timestamp_ns - prior.timestamp_ns < PRIOR_TIMEOUT_NS;
+    reloc_correction_t prior_now;
+    if (fresh) reloc_extrapolate(&prior, then.timestamp_ns, then.odometer_m, &prior_now);
+
+    // unknown tags are only placed while relocalized, by this frame's fit or
+    // recent history, and never feed back into the fit
+    reloc_correction_t c;
+    if (n_obs > 0 && fuse(obs, n_obs, &then, fresh ? &prior_now : NULL, &c) == 0) {
+        learn_tags(unknown, n_unknown, &c);
+    } else if (fresh) {
+        learn_tags(unknown, n_unknown, &prior_now);
+    }
+}
+
+static void _tag_detection_cb(__attribute__((unused)) int ch, char* data, int bytes,
+                              __attribute__((unused)) void* context)
+{
+    int n_packets;
+    tag_detection_t* d = pipe_validate_tag_detection_t(data, bytes, &n_packets);
+    if (!d) return;
+
+    // detections from the same camera frame share a timestamp
+    reloc_map_t map;
+    int have_map = (acquire_map(&map) == 0);
+    for (int i = 0; have_map && i < n_packets;) {
+        int k = i + 1;
+        while (k < n_packets && d[k].timestamp_ns == d[i].timestamp_ns) k++;
+        process_frame(&map, &d[i], k - i);
+        i = k;
+    }
+    release_map();
+}
+
+
+int reloc_start(reloc_map_acquire_t* acquire, reloc_map_release_t* release,
+                int en_kalman, int filter_len, const char* learn_path)
+{
+    acquire_map = acquire;
+    release_map = release;
+    drift_model_reset(&drift);
+
+    if (learn_path) {
+        snprintf(learn_file, sizeof(learn_file), "%s", learn_path);
+        if (tag_learn_init(&learned, learn_file)) {
+            fprintf(stderr, "ERROR: failed to start tag learning\n");
+            return -1;
+        }
+        learn_en = 1;
+    }
+
+    if (frame_filter_init(&filter, en_kalman ? FRAME_FILTER_KALMAN : FRAME_FILTER_AVERAGE, filter_len) ||
+        rc_matrix_alloc(&R_tag_to_cam, 3, 3) || rc_vector_alloc(&T_tag_wrt_cam, 3) ||
+        rc_matrix_alloc(&R_tag_to_local, 3, 3) || rc_vector_alloc(&T_tag_wrt_local, 3)) {
+        fprintf(stderr, "ERROR: failed to allocate relocalization buffers\n");
+        reloc_stop();
+        return -1;
+    }
+
+    pipe_ch = pipe_client_get_next_available_channel();
+    pipe_client_set_simple_helper_cb(pipe_ch, _tag_detection_cb, NULL);
+    // the client keeps trying in the background if the tag detector isn't up yet
+    if (pipe_client_open(pipe_ch, TAG_DETECTION_PIPE, PROCESS_NAME,
+                         CLIENT_FLAG_EN_SIMPLE_HELPER, TAG_DETECTION_RECOMMENDED_READ_BUF_SIZE)) {
+        fprintf(stderr, "WARNING: %s pipe not available yet\n", TAG_DETECTION_PIPE);
+    }
+    return 0;
+}
+
+
+void reloc_stop(void)
+{
+    if (pipe_ch >= 0) {
+        pipe_client_close(pipe_ch);
+        pipe_ch = -1;
+    }
+    rc_matrix_free(&R_tag_to_cam);
+    rc_vector_free(&T_tag_wrt_cam);
+    rc_matrix_free(&R_tag_to_local);
+    rc_vector_free(&T_tag_wrt_local);
+    frame_filter_free(&filter);
+    if (learn_en) {
+        reloc_save_learned();
+        tag_learn_free(&learned);
+        learn_en = 0;
+    }
+
+    reloc_correction_t identity = { .cos_yaw = 1.0f };
+    publish(&identity);
+    have_prior = 0;
+}
+
+
+int reloc_save_learned(void)
+{
+    if (!learn_en) return 0;
+    return tag_learn_save(&learned, learn_file);
+}
+
+
+void reloc_en_print_debug(int debug)
+{
+    if (debug) en_debug = 1;
+}
@@ -0,0 +1,127 @@
+#ifndef RELOC_H
+#define RELOC_H
+
+#include <stdint.h>
+
+#include "tag_map.h"
+#include "tag_visibility.h"
+
+/**
+ * Tag based relocalization for lines mode.
+ *
+ * Tag detections are matched against the surveyed poses in the mission's tag
+ * map to estimate the yaw and translation taking the vehicle's local (VIO)
+ * frame onto the map frame the path is written in. Gravity keeps roll and
+ * pitch of the two frames aligned, so only yaw is corrected. All surveyed
+ * tags seen in one camera frame are fused into a single weighted fit.
+ *
+ * When the segment being flown is known, detections are checked against the
+ * tags predicted visible from it. Unexpected tags are dropped before any
+ * geometry is done, and camera frames are skipped outright where no tag is
+ * expected.
+ *
+ * With learning on, tags that are not in the map are placed in the map frame
+ * by the correction of the frame they are seen in and averaged over
+ * sightings, see tag_learn.h. They don't take part in the fit until a later
+ * mission load merges the confirmed ones into the map.
+ *
+ * Fused corrections are smoothed by a frame_filter before use, and a
+ * drift_model learns from them how fast VIO drifts so the correction can be
+ * extrapolated between sightings. A correction holds for the moment its
+ * frame was exposed and is paired with the odometry of that moment from
+ * odom_history, the sender carries it forward to the time of each tick. Estimation
+ * runs on the detection pipe's thread. The sender only reads the
+ * latest correction through a sequence lock and transforms each setpoint as
+ * it goes out, so the path is never regenerated and a tick never waits on a
+ * detection being processed.
+ */
+
+#define RELOC_MAX_EXTRAP_S 30.0f    // longest a learned drift rate is extrapolated (s)
+#define RELOC_MAX_EXTRAP_M 50.0f    // and furthest (m)
+
+typedef struct reloc_correction_t {
+    float yaw;              // rotation from local to map about z (rad)
+    float cos_yaw, sin_yaw;
+    float x, y, z;          // map = R(yaw) * local + (x,y,z)
+    int64_t timestamp_ns;   // detection time of the last update, 0 before the first
+    int n_tags;             // tags fused into the last update
+    float odometer_m;       // distance travelled at timestamp_ns, see odom_history.h
+    float drift_per_s[4];   // learned change of x, y, z, yaw per second, 0 until learned
+    float drift_per_m[4];   // and per meter travelled
+} reloc_correction_t;
+
+// what a detection is matched against, borrowed from the current mission
+typedef struct reloc_map_t {
+    const tag_map_t* tags;
+    const tag_visibility_t* visible;    // tags expected per segment, NULL if not predicted
+    int seg;                            // segment being flown, -1 if unknown
+} reloc_map_t;
+
+// called from the detection thread to borrow the map, returns 0 if there is one
+typedef int reloc_map_acquire_t(reloc_map_t* map);
+typedef void reloc_map_release_t(void);
+
+
+/**
+ * @brief      subscribe to tag detections and start estimating corrections
+ *
+ *             The map callbacks let the caller keep the tag map alive while a
+ *             detection is matched against it. release is called after every
+ *             acquire, successful or not.
+ *
+ * @param[in]  en_kalman   smooth with the kalman filter instead of an average
+ * @param[in]  filter_len  moving average window in tag frames
+ * @param[in]  learn_path  file unsurveyed tags are learned into, NULL to not learn
+ *
+ * @return     0 on success, -1 on failure
+ */
+int reloc_start(reloc_map_acquire_t* acquire, reloc_map_release_t* release,
+                int en_kalman, int filter_len, const char* learn_path);
+
+// stop listening, save what was learned and forget the correction
+void reloc_stop(void);
+
+/**
+ * @brief      write the learned tags to the learn file
+ *
+ * @return     number of confirmed tags, 0 when not learning, -1 on failure
+ */
+int reloc_save_learned(void);
+
+/**
+ * @brief      latest correction, identity until the first tag is matched
+ *
+ *             Lock free, safe to call every tick.
+ */
+void reloc_get_correction(reloc_correction_t* c);
+
+/**
+ * @brief      correction predicted for now from the latest one and its drift
+ *
+ *             Extrapolation is capped at RELOC_MAX_EXTRAP_S and
+ *             RELOC_MAX_EXTRAP_M past the last sighting. out may alias c.
+ */
+void reloc_extrapolate(const reloc_correction_t* c, int64_t now_ns, float odometer_m,
+                       reloc_correction_t* out);
+
+/**
+ * @brief      start counting confirmations of one tag, -1 to stop
+ *
+ *             A confirmation is a camera frame in which the tag was matched
+ *             and agreed with the rest of the frame and recent history.
+ */
+void reloc_watch_tag(int id);
+
+// confirmations of the watched tag since reloc_watch_tag()
+int reloc_watch_count(void);
+
+// transform a map frame point into the local frame, and back
+void reloc_map_to_local(const reloc_correction_t* c, float* x, float* y, float* z);
+void reloc_local_to_map(const reloc_correction_t* c, float* x, float* y, float* z);
+
+// rotate a map frame vector (velocity, acceleration) into the local frame
+void reloc_rotate_to_local(const reloc_correction_t* c, float* x, float* y);
+
+void reloc_en_print_debug(int debug);
+
+#endif // RELOC_H
@@ -0,0 +1,174 @@
+#include <math.h>
+
+#include "reloc_solve.h"
+
+#define MIN_RANGE_M 0.3f        // closer detections are weighted as if this far
+#define MIN_VIEW_COS 0.1f       // floor on the cosine of the viewing angle
+
+
+float reloc_obs_weight(const float T_tag_wrt_cam[3], const float R_tag_to_cam[3][3], float size_m)
+{
+    float r = sqrtf(T_tag_wrt_cam[0] * T_tag_wrt_cam[0] +
+                    T_tag_wrt_cam[1] * T_tag_wrt_cam[1] +
+                    T_tag_wrt_cam[2] * T_tag_wrt_cam[2]);
+    if (r < MIN_RANGE_M) r = MIN_RANGE_M;
+
+    // the tag's z axis is its normal, compare it to the line of sight
+    float dot = R_tag_to_cam[0][2] * T_tag_wrt_cam[0] +
+                R_tag_to_cam[1][2] * T_tag_wrt_cam[1] +
+                R_tag_to_cam[2][2] * T_tag_wrt_cam[2];
+    float view_cos = fabsf(dot) / r;
+    if (view_cos < MIN_VIEW_COS) view_cos = MIN_VIEW_COS;
+
+    if (size_m <= 0.0f) size_m = 1.0f;
+    return size_m * view_cos / (r * r);
+}
+
+
+int reloc_solve(const reloc_obs_t* obs, int n, reloc_correction_t* c, float* rms)
+{
+    if (n < 1) return -1;
+    if (n > RELOC_MAX_TAGS) n = RELOC_MAX_TAGS;
+
+    // each tag as two point pairs: its center, and a point ahead along its yaw
+    float lx[2 * RELOC_MAX_TAGS], ly[2 * RELOC_MAX_TAGS];
+    float mx[2 * RELOC_MAX_TAGS], my[2 * RELOC_MAX_TAGS];
+    float w[2 * RELOC_MAX_TAGS];
+    float sum_w = 0.0f, sum_z = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        const reloc_obs_t* o = &obs[i];
+        lx[2*i] = o->local[0];
+        ly[2*i] = o->local[1];
+        mx[2*i] = o->map[0];
+        my[2*i] = o->map[1];
+        lx[2*i+1] = o->local[0] + RELOC_HEADING_ARM_M * cosf(o->yaw_local);
+        ly[2*i+1] = o->local[1] + RELOC_HEADING_ARM_M * sinf(o->yaw_local);
+        mx[2*i+1] = o->map[0] + RELOC_HEADING_ARM_M * cosf(o->yaw_map);
+        my[2*i+1] = o->map[1] + RELOC_HEADING_ARM_M * sinf(o->yaw_map);
+        w[2*i] = w[2*i+1] = o->weight;
+        sum_w += o->weight;
+        sum_z += o->weight * (o->map[2] - o->local[2]);
+    }
+    if (sum_w <= 0.0f) return -1;
+
+    // weighted centroids, then the rotation that best aligns the spread about them
+    float lcx = 0.0f, lcy = 0.0f, mcx = 0.0f, mcy = 0.0f;
+    for (int k = 0; k < 2 * n; ++k) {
+        lcx += w[k] * lx[k];
+        lcy += w[k] * ly[k];
+        mcx += w[k] * mx[k];
+        mcy += w[k] * my[k];
+    }
+    lcx /= 2.0f * sum_w;
+    lcy /= 2.0f * sum_w;
+    mcx /= 2.0f * sum_w;
+    mcy /= 2.0f * sum_w;
+
+    float h = 0.0f, s = 0.0f;
+    for (int k = 0; k < 2 * n; ++k) {
+        float ax = lx[k] - lcx, ay = ly[k] - lcy;
+        float bx = mx[k] - mcx, by = my[k] - mcy;
+        h += w[k] * (ax * bx + ay * by);
+        s += w[k] * (ax * by - ay * bx);
+    }
+
+    c->yaw = atan2f(s, h);
+    c->cos_yaw = cosf(c->yaw);
+    c->sin_yaw = sinf(c->yaw);
+    c->x = mcx - (c->cos_yaw * lcx - c->sin_yaw * lcy);
+    c->y = mcy - (c->sin_yaw * lcx + c->cos_yaw * lcy);
+    c->z = sum_z / sum_w;
+
+    if (rms) {
+        float err = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            float px = obs[i].local[0], py = obs[i].local[1], pz = obs[i].local[2];
+            reloc_local_to_map(c, &px, &py, &pz);
+            float dx = obs[i].map[0] - px, dy = obs[i].map[1] - py, dz = obs[i].map[2] - pz;
+            err += obs[i].weight * (dx*dx + dy*dy + dz*dz);
+        }
+        *rms = sqrtf(err / sum_w);
+    }
+    return 0;
+}
+
+
+// correction implied by one tag on its own
+static void single_tag_correction(const reloc_obs_t* o, reloc_correction_t* c)
+{
+    c->yaw = atan2f(sinf(o->yaw_map - o->yaw_local), cosf(o->yaw_map - o->yaw_local));
+    c->cos_yaw = cosf(c->yaw);
+    c->sin_yaw = sinf(c->yaw);
+    c->x = o->map[0] - (c->cos_yaw * o->local[0] - c->sin_yaw * o->local[1]);
+    c->y = o->map[1] - (c->sin_yaw * o->local[0] + c->cos_yaw * o->local[1]);
+    c->z = o->map[2] - o->local[2];
+}
+
+static float yaw_diff(float a, float b)
+{
+    return fabsf(atan2f(sinf(a - b), cosf(a - b)));
+}
+
+// does the observation agree with correction c
+static int obs_agrees(const reloc_obs_t* o, const reloc_correction_t* c)
+{
+    float x = o->local[0], y = o->local[1], z = o->local[2];
+    reloc_local_to_map(c, &x, &y, &z);
+    float dx = o->map[0] - x, dy = o->map[1] - y, dz = o->map[2] - z;
+    return (dx*dx + dy*dy + dz*dz) < RELOC_INLIER_M * RELOC_INLIER_M &&
+           yaw_diff(o->yaw_map - o->yaw_local, c->yaw) < RELOC_INLIER_YAW;
+}
+
+// do two corrections agree where the tags are
+static int corrections_agree(const reloc_correction_t* a, const reloc_correction_t* b,
+                             const float at[3])
+{
+    float ax = at[0], ay = at[1], az = at[2];
+    float bx = at[0], by = at[1], bz = at[2];
+    reloc_local_to_map(a, &ax, &ay, &az);
+    reloc_local_to_map(b, &bx, &by, &bz);
+    float dx = ax - bx, dy = ay - by, dz = az - bz;
+    return (dx*dx + dy*dy + dz*dz) < RELOC_INLIER_M * RELOC_INLIER_M &&
+           yaw_diff(a->yaw, b->yaw) < RELOC_INLIER_YAW;
+}
+
+
+int reloc_consensus(reloc_obs_t* obs, int n, const reloc_correction_t* prior)
+{
+    if (n > RELOC_MAX_TAGS) n = RELOC_MAX_TAGS;
+    if (n < 1) return 0;
+
+    // the prior votes like the strongest observation, compared where the tags are
+    float prior_w = 0.0f;
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < n; ++i) {
+        if (obs[i].weight > prior_w) prior_w = obs[i].weight;
+        for (int k = 0; k < 3; ++k) center[k] += obs[i].local[k] / n;
+    }
+
+    // the prior is tried first so a tie goes to history
+    reloc_correction_t hyp[RELOC_MAX_TAGS + 1];
+    int n_hyp = 0;
+    if (prior) hyp[n_hyp++] = *prior;
+    for (int i = 0; i < n; ++i) single_tag_correction(&obs[i], &hyp[n_hyp++]);
+
+    int best = 0;
+    float best_score = -1.0f;
+    for (int h = 0; h < n_hyp; ++h) {
+        float score = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            if (obs_agrees(&obs[i], &hyp[h])) score += obs[i].weight;
+        }
+        if (prior && corrections_agree(prior, &hyp[h], center)) score += prior_w;
+        if (score > best_score) {
+            best_score = score;
+            best = h;
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < n; ++i) {
+        if (obs_agrees(&obs[i], &hyp[best])) obs[kept++] = obs[i];
+    }
+    return kept;
+}
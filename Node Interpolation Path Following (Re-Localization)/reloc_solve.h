@@ -0,0 +1,76 @@
+#ifndef RELOC_SOLVE_H
+#define RELOC_SOLVE_H
+
+#include "reloc.h"
+
+/**
+ * Weighted least-squares fit of the local to map correction to every tag
+ * seen in one camera frame.
+ *
+ * Each tag contributes its center and a point RELOC_HEADING_ARM_M ahead of
+ * it along its yaw, in both frames. Fitting yaw plus translation to those
+ * point pairs is a 2D weighted Procrustes problem with a closed form, so a
+ * single tag reproduces its own correction exactly and several tags are
+ * fused in one pass.
+ *
+ * Before the fit, a consensus stage drops detections that disagree with the
+ * rest. One tag is enough to hypothesize a full correction, so every tag's
+ * own correction and the last accepted one are tried as hypotheses and the
+ * one most observations agree with wins. That is at most RELOC_MAX_TAGS+1
+ * hypotheses per frame, a fixed worst case with no random sampling.
+ *
+ * Everything is fixed size on the stack, nothing is allocated.
+ */
+
+#define RELOC_MAX_TAGS 16       // tags fused per frame, further ones are dropped
+#define RELOC_HEADING_ARM_M 1.0f // lever arm turning a tag's yaw into a point pair
+#define RELOC_INLIER_M 0.25f    // max position disagreement with a hypothesis (m)
+#define RELOC_INLIER_YAW 0.09f  // max yaw disagreement with a hypothesis (rad, ~5deg)
+
+typedef struct reloc_obs_t {
+    int id;
+    float local[3];         // tag position in local frame
+    float map[3];           // surveyed tag position
+    float yaw_local;        // tag yaw in local frame (rad)
+    float yaw_map;          // surveyed tag yaw (rad)
+    float weight;           // relative confidence, > 0
+} reloc_obs_t;
+
+
+/**
+ * @brief      confidence of a detection from its pose relative to the camera
+ *
+ *             Position error grows with the square of range and with how
+ *             obliquely the tag is seen, and shrinks with tag size.
+ *
+ * @param[in]  T_tag_wrt_cam  tag position in camera frame
+ * @param[in]  R_tag_to_cam   tag orientation in camera frame
+ * @param[in]  size_m         tag edge length
+ */
+float reloc_obs_weight(const float T_tag_wrt_cam[3], const float R_tag_to_cam[3][3], float size_m);
+
+/**
+ * @brief      fit the correction to n observations
+ *
+ * @param[out] c         correction, timestamp and tag count left to the caller
+ * @param[out] rms       weighted RMS residual of the tag centers (m), may be NULL
+ *
+ * @return     0 on success, -1 if there is nothing to fit
+ */
+int reloc_solve(const reloc_obs_t* obs, int n, reloc_correction_t* c, float* rms);
+
+/**
+ * @brief      keep the observations consistent with the best supported
+ *             correction, compacting them to the front of obs
+ *
+ *             The prior is the last accepted correction. It votes like the
+ *             strongest observation, so a lone tag contradicting recent
+ *             history is dropped, while the same tag with a second one
+ *             agreeing outvotes it. Pass NULL once the prior is too old to
+ *             trust, so a genuine jump is accepted eventually.
+ *
+ * @return     number of observations kept, 0 if the prior won alone
+ */
+int reloc_consensus(reloc_obs_t* obs, int n, const reloc_correction_t* prior);
+
+#endif // RELOC_SOLVE_H
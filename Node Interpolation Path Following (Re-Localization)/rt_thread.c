@@ -0,0 +1,76 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "rt_thread.h"
+#include "config_file.h"
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4                   // Linux 4.4, missing from older libc headers
+#endif
+
+#define RT_STACK_PREFAULT (64 * 1024)   // stack a control loop may reach, well under the default 8MB
+
+
+// touch the stack below the caller so those pages are mapped before they are needed
+static __attribute__((noinline)) void prefault_stack(void)
+{
+    char stack[RT_STACK_PREFAULT];
+    memset(stack, 0, sizeof(stack));
+    __asm__ volatile("" : : "r"(stack) : "memory"); // keep the writes
+}
+
+
+static const rt_thread_cfg_t* find(const char* name)
+{
+    for (int i = 0; i < n_rt_threads; i++) {
+        if (strcmp(rt_threads[i].name, name) == 0) return &rt_threads[i];
+    }
+    return NULL;
+}
+
+
+int rt_thread_apply(const char* name)
+{
+    pthread_setname_np(pthread_self(), name);
+    prefault_stack();
+
+    const rt_thread_cfg_t* c = find(name);
+    if (!c) return 0;
+
+    int ret = 0;
+    if (c->n_cpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int k = 0; k < c->n_cpus; k++) CPU_SET(c->cpus[k], &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err) {
+            fprintf(stderr, "WARNING: failed to pin %s thread: %s\n", name, strerror(err));
+            ret = -1;
+        }
+    }
+    if (c->priority > 0) {
+        struct sched_param param = { .sched_priority = c->priority };
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err) {
+            fprintf(stderr, "WARNING: failed to set %s thread priority: %s\n", name, strerror(err));
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+
+int rt_lock_memory(void)
+{
+    if (!rt_mlockall) return 0;
+    // only pages in use are locked, so the untouched bulk of each 8MB thread stack costs nothing
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT)) {
+        perror("WARNING: mlockall failed, memory may be paged out in flight");
+        return -1;
+    }
+    return 0;
+}
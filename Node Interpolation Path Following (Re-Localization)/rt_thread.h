@@ -0,0 +1,38 @@
+#ifndef RT_THREAD_H
+#define RT_THREAD_H
+
+/**
+ * Real-time placement of vision hub threads, from the rt_threads config.
+ *
+ * Threads are created with a fixed SCHED_FIFO priority and may run on any
+ * core, so the scheduler is free to migrate the offboard loop onto a core
+ * busy with camera or VOA work. Each thread that cares calls
+ * rt_thread_apply() with its name as it starts, which pins it to the cores
+ * configured for that name, sets its priority when one is configured and
+ * faults in the top of its stack so the first deep call of a tick doesn't.
+ *
+ * rt_lock_memory() locks the process in RAM once at startup. Pages are
+ * locked as they are faulted in rather than all up front, so untouched stack
+ * and heap reservations cost nothing. Missions are written in full or read
+ * through by their checksum while loading, so everything the control loop
+ * reads is locked before it flies and can't be paged out from under it.
+ */
+
+/**
+ * @brief      apply the rt_threads entry for name to the calling thread
+ *
+ *             A name with no entry only gets its stack faulted in. Failures
+ *             are warned about and the thread carries on as created.
+ *
+ * @return     0 on success, -1 if the affinity or priority was refused
+ */
+int rt_thread_apply(const char* name);
+
+/**
+ * @brief      mlockall() the process when rt_mlockall is enabled
+ *
+ * @return     0 on success or when disabled, -1 on failure
+ */
+int rt_lock_memory(void);
+
+#endif // RT_THREAD_H
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tag_learn.h"
+#include "path_binary.h"
+#include "macros.h"
+
+_Static_assert(sizeof(learned_tag_t) == 36, "bump TAG_LEARN_VERSION");
+
+
+static int confirmed(const learned_tag_t* t)
+{
+    return t->sightings >= TAG_LEARN_MIN_SIGHTINGS &&
+           t->spread2 <= TAG_LEARN_MAX_SPREAD_M * TAG_LEARN_MAX_SPREAD_M;
+}
+
+/*
+ * read and validate a learned file, *tags is malloced. A missing file is an
+ * empty one.
+ */
+static int read_file(const char* file, learned_tag_t** tags, int* n_tags)
+{
+    *tags = NULL;
+    *n_tags = 0;
+    FILE* fp = fopen(file, "rb");
+    if (!fp) return 0;
+
+    tag_learn_header_t h;
+    const char* err = NULL;
+    if (fread(&h, sizeof(h), 1, fp) != 1) err = "truncated file";
+    else if (h.magic != TAG_LEARN_MAGIC) err = "bad magic number";
+    else if (h.version != TAG_LEARN_VERSION) err = "unsupported version";
+    else if (h.n_tags > 0) {
+        *tags = malloc(h.n_tags * sizeof(learned_tag_t));
+        if (!*tags) err = "out of memory";
+        else if (fread(*tags, sizeof(learned_tag_t), h.n_tags, fp) != h.n_tags) err = "truncated file";
+        else if (path_bin_crc32(*tags, h.n_tags * sizeof(learned_tag_t)) != h.crc32) err = "checksum mismatch";
+    }
+    fclose(fp);
+
+    if (err) {
+        fprintf(stderr, "ERROR: %s: %s\n", file, err);
+        free(*tags);
+        *tags = NULL;
+        return -1;
+    }
+    *n_tags = h.n_tags;
+    return 0;
+}
+
+// slot for id, added empty if it is new. Call with the lock held.
+static learned_tag_t* find_or_add(tag_learn_t* l, int id)
+{
+    const apriltag_pose_t* p = tag_map_find(&l->index, id);
+    if (p) return &l->tags[p - l->index.tags];
+
+    // room for the new tag first, so a failure leaves the index untouched
+    if (l->index.n_tags == l->cap_tags) {
+        int capacity = l->cap_tags ? l->cap_tags * 2 : 16;
+        learned_tag_t* tags = realloc(l->tags, capacity * sizeof(learned_tag_t));
+        if (!tags) return NULL;
+        l->tags = tags;
+        l->cap_tags = capacity;
+    }
+    apriltag_pose_t key = { .id = id };
+    if (tag_map_add(&l->index, &key)) return NULL;
+
+    learned_tag_t* t = &l->tags[l->index.n_tags - 1];
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    return t;
+}
+
+
+int tag_learn_init(tag_learn_t* l, const char* file)
+{
+    memset(l, 0, sizeof(*l));
+    pthread_mutex_init(&l->lock, NULL);
+
+    learned_tag_t* loaded;
+    int n_loaded;
+    if (read_file(file, &loaded, &n_loaded)) {
+        fprintf(stderr, "WARNING: starting tag learning over\n");
+        n_loaded = 0;
+    }
+    if (tag_map_init(&l->index, n_loaded, NULL)) {
+        free(loaded);
+        return -1;
+    }
+
+    for (int k = 0; k < n_loaded; ++k) {
+        learned_tag_t* t = find_or_add(l, loaded[k].id);
+        if (t) *t = loaded[k];
+    }
+    free(loaded);
+    if (n_loaded) printf("Carrying on learning %d tags from %s\n", n_loaded, file);
+    return 0;
+}
+
+
+void tag_learn_add(tag_learn_t* l, int id, const float map[3], float yaw, float weight)
+{
+    if (weight <= 0.0f) return;
+    pthread_mutex_lock(&l->lock);
+    learned_tag_t* t = find_or_add(l, id);
+    if (t && t->sightings == 0) {
+        t->x = map[0];
+        t->y = map[1];
+        t->z = map[2];
+        t->cos_yaw = cosf(yaw);
+        t->sin_yaw = sinf(yaw);
+        t->weight = weight;
+        t->sightings = 1;
+    } else if (t) {
+        // weighted running mean and spread, one pass per sighting
+        float w_new = t->weight + weight;
+        float k = weight / w_new;
+        float d[3] = { map[0] - t->x, map[1] - t->y, map[2] - t->z };
+        t->x += k * d[0];
+        t->y += k * d[1];
+        t->z += k * d[2];
+        float m2 = t->spread2 * t->weight + weight * (1.0f - k) * (d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+        t->spread2 = m2 / w_new;
+        t->cos_yaw += k * (cosf(yaw) - t->cos_yaw);
+        t->sin_yaw += k * (sinf(yaw) - t->sin_yaw);
+        t->weight = w_new;
+        t->sightings++;
+    }
+    pthread_mutex_unlock(&l->lock);
+}
+
+
+int tag_learn_save(tag_learn_t* l, const char* file)
+{
+    pthread_mutex_lock(&l->lock);
+    tag_learn_header_t h = {
+        .magic = TAG_LEARN_MAGIC,
+        .version = TAG_LEARN_VERSION,
+        .n_tags = l->index.n_tags
+    };
+    h.crc32 = path_bin_crc32(l->tags, h.n_tags * sizeof(learned_tag_t));
+    int n_confirmed = 0;
+    for (uint32_t k = 0; k < h.n_tags; ++k) n_confirmed += confirmed(&l->tags[k]);
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE* fp = fopen(tmp, "wb");
+    int ok = fp && fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(l->tags, sizeof(learned_tag_t), h.n_tags, fp) == h.n_tags;
+    if (fp) ok = (fclose(fp) == 0) && ok;
+    pthread_mutex_unlock(&l->lock);
+
+    if (!ok || rename(tmp, file)) {
+        fprintf(stderr, "ERROR: failed to write %s\n", file);
+        remove(tmp);
+        return -1;
+    }
+    return n_confirmed;
+}
+
+
+int tag_learn_merge(const char* file, tag_map_t* map)
+{
+    learned_tag_t* tags;
+    int n_tags;
+    if (read_file(file, &tags, &n_tags)) return -1;
+
+    int added = 0;
+    for (int k = 0; k < n_tags; ++k) {
+        const learned_tag_t* t = &tags[k];
+        if (!confirmed(t) || tag_map_find(map, t->id)) continue;
+        apriltag_pose_t pose = {
+            .id = t->id,
+            .x = t->x,
+            .y = t->y,
+            .z = t->z,
+            .yaw_deg = (float)((double)atan2f(t->sin_yaw, t->cos_yaw) * RAD_TO_DEG)
+        };
+        if (tag_map_add(map, &pose)) {
+            free(tags);
+            return -1;
+        }
+        added++;
+    }
+    free(tags);
+    return added;
+}
+
+
+void tag_learn_free(tag_learn_t* l)
+{
+    tag_map_free(&l->index);
+    free(l->tags);
+    l->tags = NULL;
+    l->cap_tags = 0;
+    pthread_mutex_destroy(&l->lock);
+}
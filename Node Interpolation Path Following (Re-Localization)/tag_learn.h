@@ -0,0 +1,89 @@
+#ifndef TAG_LEARN_H
+#define TAG_LEARN_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "tag_map.h"
+
+/**
+ * Map poses of tags that are not surveyed, learned in flight.
+ *
+ * While relocalized, every sighting of an unknown tag gives an estimate of
+ * its map pose. Sightings are averaged per tag, weighted like the fit weighs
+ * surveyed tags, and kept with their spread. The averages are written to a
+ * compact checksummed binary file after landing and loaded again on the next
+ * flight, so refinement carries on across flights. Tags seen often enough
+ * and consistently enough are confirmed and join the mission's tag map, a
+ * surveyed pose always wins over a learned one.
+ *
+ * File layout, native little-endian like path_binary:
+ *   tag_learn_header_t
+ *   learned_tag_t tags[n_tags]
+ */
+
+#define TAG_LEARN_MAGIC     0x4E524C54u // "TLRN" little-endian
+#define TAG_LEARN_VERSION   1
+#define TAG_LEARN_MIN_SIGHTINGS 20      // sightings before a tag is used
+#define TAG_LEARN_MAX_SPREAD_M 0.15f    // RMS disagreement between sightings of a usable tag
+
+typedef struct learned_tag_t {
+    int32_t id;
+    float x, y, z;          // weighted mean map position
+    float cos_yaw, sin_yaw; // weighted mean of the yaw on the unit circle
+    float weight;           // sum of sighting weights
+    float spread2;          // weighted mean squared distance of the sightings from x,y,z
+    uint32_t sightings;
+} learned_tag_t;
+
+typedef struct tag_learn_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_tags;
+    uint32_t crc32;         // CRC-32 of the tags
+} tag_learn_header_t;
+
+typedef struct tag_learn_t {
+    learned_tag_t* tags;
+    int cap_tags;
+    tag_map_t index;        // by id, index k holds the id of tags[k]
+    pthread_mutex_t lock;   // sightings come from the detection thread, saves from the sender
+} tag_learn_t;
+
+
+/**
+ * @brief      start learning, carrying on from file if it exists
+ *
+ * @return     0 on success, -1 on failure
+ */
+int tag_learn_init(tag_learn_t* l, const char* file);
+
+/**
+ * @brief      add one sighting of a tag that is not surveyed
+ *
+ * @param[in]  map     estimated map position
+ * @param[in]  yaw     estimated map yaw (rad)
+ * @param[in]  weight  confidence of the sighting, see reloc_obs_weight()
+ */
+void tag_learn_add(tag_learn_t* l, int id, const float map[3], float yaw, float weight);
+
+/**
+ * @brief      write everything learned so far, replacing file atomically
+ *
+ * @return     number of confirmed tags, -1 on failure
+ */
+int tag_learn_save(tag_learn_t* l, const char* file);
+
+/**
+ * @brief      add the confirmed tags of a learned file to a map
+ *
+ *             Tags already in the map keep their pose. A missing file adds
+ *             nothing.
+ *
+ * @return     number of tags added, -1 on a corrupt file or out of memory
+ */
+int tag_learn_merge(const char* file, tag_map_t* map);
+
+void tag_learn_free(tag_learn_t* l);
+
+#endif // TAG_LEARN_H
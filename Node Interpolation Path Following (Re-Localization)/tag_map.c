@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "tag_map.h"
+#include "csv_reader.h"
+
+#define MIN_SLOTS 16
+
+
+static void* map_alloc(tag_map_t* map, void* ptr, size_t size)
+{
+    return map->arena ? arena_realloc(map->arena, ptr, size) : realloc(ptr, size);
+}
+
+static unsigned int hash_id(int id)
+{
+    // Fibonacci hashing spreads sequential ids across the table
+    return (unsigned int)id * 2654435761u;
+}
+
+// slot holding id, or the empty slot where it would go
+static unsigned int find_slot(const tag_map_t* map, int id)
+{
+    unsigned int i = hash_id(id) & map->mask;
+    while (map->slots[i] >= 0 && map->tags[map->slots[i]].id != id) {
+        i = (i + 1) & map->mask;
+    }
+    return i;
+}
+
+// size the slot table for capacity tags and index everything stored
+static int rebuild_slots(tag_map_t* map, int capacity)
+{
+    unsigned int n_slots = MIN_SLOTS;
+    while (n_slots < 2u * (unsigned int)capacity) n_slots <<= 1;
+
+    // arena storage is not reclaimed, a fresh table avoids copying stale slots
+    int* slots = map->arena ? arena_alloc(map->arena, n_slots * sizeof(int))
+                            : realloc(map->slots, n_slots * sizeof(int));
+    if (!slots) return -1;
+    memset(slots, 0xFF, n_slots * sizeof(int));
+    map->slots = slots;
+    map->mask = n_slots - 1;
+
+    for (int k = 0; k < map->n_tags; ++k) {
+        map->slots[find_slot(map, map->tags[k].id)] = k;
+    }
+    return 0;
+}
+
+
+int tag_map_init(tag_map_t* map, int capacity, arena_t* arena)
+{
+    memset(map, 0, sizeof(*map));
+    map->arena = arena;
+    if (capacity < 1) capacity = 1;
+
+    map->tags = map_alloc(map, NULL, capacity * sizeof(apriltag_pose_t));
+    if (!map->tags) return -1;
+    map->cap_tags = capacity;
+    return rebuild_slots(map, capacity);
+}
+
+
+int tag_map_add(tag_map_t* map, const apriltag_pose_t* pose)
+{
+    unsigned int i = find_slot(map, pose->id);
+    if (map->slots[i] >= 0) {
+        map->tags[map->slots[i]] = *pose;
+        return 0;
+    }
+
+    if (map->n_tags == map->cap_tags) {
+        int capacity = map->cap_tags * 2;
+        apriltag_pose_t* tags = map_alloc(map, map->tags, capacity * sizeof(apriltag_pose_t));
+        if (!tags) return -1;
+        map->tags = tags;
+        map->cap_tags = capacity;
+        if (rebuild_slots(map, capacity)) return -1;
+        i = find_slot(map, pose->id);
+    }
+
+    map->tags[map->n_tags] = *pose;
+    map->slots[i] = map->n_tags++;
+    return 0;
+}
+
+
+int tag_map_parse_id(float value, int* id)
+{
+    // negated so NaN fails too, and compared as double where INT32_MAX is exact
+    if (!(value >= 0.0f) || value != floorf(value) || (double)value > INT32_MAX) return -1;
+    *id = (int)value;
+    return 0;
+}
+
+
+int tag_map_load_csv(tag_map_t* map, const char* file, arena_t* arena)
+{
+    csv_table_t t;
+    if (csv_load(&t, file, 5, 5, arena)) return -1;
+
+    int ret = tag_map_init(map, t.n_rows, arena);
+    for (int i = 0; ret == 0 && i < t.n_rows; ++i) {
+        apriltag_pose_t pose = {
+            .x = t.col[1][i],
+            .y = t.col[2][i],
+            .z = t.col[3][i],
+            .yaw_deg = t.col[4][i]
+        };
+        if (tag_map_parse_id(t.col[0][i], &pose.id)) {
+            fprintf(stderr, "ERROR: %s tag %d: id %g is not a valid id\n", file, i + 1, (double)t.col[0][i]);
+            ret = -1;
+            break;
+        }
+        if (tag_map_find(map, pose.id)) {
+            fprintf(stderr, "WARNING: %s lists tag %d more than once, using the last pose\n",
+                    file, pose.id);
+        }
+        ret = tag_map_add(map, &pose);
+    }
+    csv_free(&t);
+    return ret;
+}
+
+
+const apriltag_pose_t* tag_map_find(const tag_map_t* map, int id)
+{
+    if (!map->slots) return NULL;
+    int k = map->slots[find_slot(map, id)];
+    return (k < 0) ? NULL : &map->tags[k];
+}
+
+
+void tag_map_free(tag_map_t* map)
+{
+    arena_t* arena = map->arena;
+    if (!arena) {
+        free(map->tags);
+        free(map->slots);
+    }
+    memset(map, 0, sizeof(*map));
+    map->arena = arena;
+}
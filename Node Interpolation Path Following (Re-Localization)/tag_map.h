@@ -0,0 +1,79 @@
+#ifndef TAG_MAP_H
+#define TAG_MAP_H
+
+/**
+ * Surveyed AprilTag poses keyed by tag id.
+ *
+ * Poses are kept in one dense array in load order, with an open addressing
+ * table of indices into it for lookups. The table is a power of two at
+ * least twice the number of tags, so a lookup probes a slot or two however
+ * many tags are surveyed. Storage is sized from the file, and the table is
+ * rebuilt larger if tags are added beyond that.
+ */
+
+#include "arena.h"
+
+typedef struct apriltag_pose_t {
+    int id;
+    float x, y, z;
+    float yaw_deg;
+} apriltag_pose_t;
+
+typedef struct tag_map_t {
+    apriltag_pose_t* tags;  // n_tags poses in load order
+    int n_tags;
+    int cap_tags;
+    int* slots;             // index into tags, -1 for empty
+    unsigned int mask;      // number of slots - 1
+    arena_t* arena;         // owner of the storage, NULL for malloc
+} tag_map_t;
+
+
+/**
+ * @brief      empty map with room for capacity tags
+ *
+ * @param[in]  arena  allocate from here, or NULL to malloc
+ *
+ * @return     0 on success, -1 on failure
+ */
+int tag_map_init(tag_map_t* map, int capacity, arena_t* arena);
+
+/**
+ * @brief      add a tag pose, replacing any pose already stored for its id
+ *
+ * @return     0 on success, -1 when out of memory
+ */
+int tag_map_add(tag_map_t* map, const apriltag_pose_t* pose);
+
+/**
+ * @brief      tag id from a CSV cell
+ *
+ *             Ids are whole numbers from 0 to INT32_MAX. Anything else,
+ *             including a fraction or a number too large for an int, is
+ *             not a tag id.
+ *
+ * @return     0 with *id set, -1 if value is not a valid id
+ */
+int tag_map_parse_id(float value, int* id);
+
+/**
+ * @brief      load id,x,y,z,yaw_deg rows from a CSV file into an empty map
+ *
+ *             Every id is checked with tag_map_parse_id(). Tags listed
+ *             twice keep their last pose, with a warning.
+ *
+ * @return     0 on success, -1 on failure
+ */
+int tag_map_load_csv(tag_map_t* map, const char* file, arena_t* arena);
+
+/**
+ * @brief      surveyed pose of a tag
+ *
+ * @return     pointer into the map or NULL if the tag is not surveyed
+ */
+const apriltag_pose_t* tag_map_find(const tag_map_t* map, int id);
+
+// release storage, a no-op for arena storage
+void tag_map_free(tag_map_t* map);
+
+#endif // TAG_MAP_H
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tag_visibility.h"
+
+#define VIS_STEP_M 0.25f        // spacing of the camera poses tried along a segment
+#define VIS_PAD_M 1.0f          // path taken into account either side of a segment
+#define VIS_PAD_RAD 0.17f       // field of view padding for tilt while accelerating (~10deg)
+
+/*
+ * Tags bucketed on a horizontal grid with cells as large as the camera
+ * range, so every tag in range of a point is in the 3x3 cells around it.
+ * Only needed while building.
+ */
+typedef struct tag_grid_t {
+    float cell;
+    unsigned int mask;
+    int* bucket_start;      // n_buckets+1 offsets into entries
+    int* entries;           // tag indices
+} tag_grid_t;
+
+// everything register_segment() needs, fixed for the whole build
+typedef struct build_t {
+    const path_t* p;
+    const tag_map_t* map;
+    const tag_camera_t* cam;
+    tag_grid_t grid;
+    float axis[3];          // optical axis in the path frame
+    float cos_half_fov;
+    int* seen;              // per tag, stamp of the last segment it was listed for
+} build_t;
+
+
+static unsigned int cell_hash(int ix, int iy)
+{
+    return ((unsigned int)ix * 73856093u) ^ ((unsigned int)iy * 19349663u);
+}
+
+static unsigned int tag_bucket(const tag_grid_t* g, float x, float y)
+{
+    return cell_hash((int)floorf(x / g->cell), (int)floorf(y / g->cell)) & g->mask;
+}
+
+static void grid_free(tag_grid_t* g)
+{
+    free(g->bucket_start);
+    free(g->entries);
+}
+
+static int grid_build(tag_grid_t* g, const tag_map_t* map, float cell)
+{
+    unsigned int n_buckets = 64;
+    while (n_buckets < 2u * map->n_tags && n_buckets < (1u << 24)) n_buckets <<= 1;
+    g->cell = cell;
+    g->mask = n_buckets - 1;
+    g->bucket_start = calloc(n_buckets + 1, sizeof(int));
+    g->entries = malloc((map->n_tags ? map->n_tags : 1) * sizeof(int));
+    int* cursor = calloc(n_buckets, sizeof(int));
+    if (!g->bucket_start || !g->entries || !cursor) {
+        free(cursor);
+        grid_free(g);
+        return -1;
+    }
+
+    for (int t = 0; t < map->n_tags; ++t) cursor[tag_bucket(g, map->tags[t].x, map->tags[t].y)]++;
+    for (unsigned int b = 0; b < n_buckets; ++b) {
+        g->bucket_start[b+1] = g->bucket_start[b] + cursor[b];
+        cursor[b] = g->bucket_start[b];
+    }
+    for (int t = 0; t < map->n_tags; ++t) {
+        g->entries[cursor[tag_bucket(g, map->tags[t].x, map->tags[t].y)]++] = t;
+    }
+    free(cursor);
+    return 0;
+}
+
+
+// is the tag inside the camera's range and field of view from camera position c
+static int tag_in_view(const build_t* b, const apriltag_pose_t* tag, const float c[3])
+{
+    float dx = tag->x - c[0], dy = tag->y - c[1], dz = tag->z - c[2];
+    float r2 = dx*dx + dy*dy + dz*dz;
+    if (r2 > b->cam->range_m * b->cam->range_m) return 0;
+    if (r2 < 1e-6f) return 1;
+    float along = dx * b->axis[0] + dy * b->axis[1] + dz * b->axis[2];
+    return along >= b->cos_half_fov * sqrtf(r2);
+}
+
+/*
+ * Sample camera poses over segment i and its padding and report every tag in
+ * view once. With count set, only tally the segment's list length, otherwise
+ * write the tags at the fill cursor. stamp tells segments and passes apart.
+ */
+static void register_segment(const build_t* b, tag_visibility_t* v, int i, int stamp,
+                             int* fill, int count)
+{
+    const path_t* p = b->p;
+    const path_segment_t* g = &p->seg[i];
+    float s_lo = g->s0 - VIS_PAD_M;
+    float s_hi = g->s0 + g->len + VIS_PAD_M;
+    if (s_lo < 0.0f) s_lo = 0.0f;
+    if (s_hi > p->length) s_hi = p->length;
+    int steps = (int)ceilf((s_hi - s_lo) / VIS_STEP_M);
+    if (steps < 1) steps = 1;
+
+    int k_seg = -1;
+    for (int k = 0; k <= steps; ++k) {
+        float s = s_lo + (s_hi - s_lo) * k / steps;
+        k_seg = path_find_segment(p, s, k_seg);
+        const path_segment_t* h = &p->seg[k_seg];
+        float d = s - h->s0;
+        float c[3] = {
+            p->x[k_seg] + h->ux * d + b->cam->T_cam_wrt_body[0],
+            p->y[k_seg] + h->uy * d + b->cam->T_cam_wrt_body[1],
+            p->z[k_seg] + h->uz * d + b->cam->T_cam_wrt_body[2]
+        };
+
+        int cx = (int)floorf(c[0] / b->grid.cell);
+        int cy = (int)floorf(c[1] / b->grid.cell);
+        for (int ox = -1; ox <= 1; ++ox) {
+            for (int oy = -1; oy <= 1; ++oy) {
+                unsigned int bk = cell_hash(cx + ox, cy + oy) & b->grid.mask;
+                for (int e = b->grid.bucket_start[bk]; e < b->grid.bucket_start[bk+1]; ++e) {
+                    int t = b->grid.entries[e];
+                    if (b->seen[t] == stamp || !tag_in_view(b, &b->map->tags[t], c)) continue;
+                    b->seen[t] = stamp;
+                    if (count) v->seg_start[i+1]++;
+                    else v->tags[(*fill)++] = t;
+                }
+            }
+        }
+    }
+}
+
+
+int tag_visibility_build(tag_visibility_t* v, const path_t* p, const tag_map_t* map,
+                         const tag_camera_t* cam, arena_t* arena)
+{
+    memset(v, 0, sizeof(*v));
+    if (p->n_nodes < 2 || cam->range_m <= 0.0f) return -1;
+    int n_seg = p->n_nodes - 1;
+
+    build_t b = { .p = p, .map = map, .cam = cam };
+    // camera z is its optical axis, the body is level at zero yaw so body and path frame agree
+    for (int k = 0; k < 3; ++k) b.axis[k] = cam->R_cam_to_body[k][2];
+    float half = 0.5f * cam->fov_rad + VIS_PAD_RAD;
+    b.cos_half_fov = (half >= (float)M_PI) ? -1.0f : cosf(half);
+
+    v->seg_start = arena_alloc(arena, (n_seg + 1) * sizeof(int));
+    b.seen = malloc((map->n_tags ? map->n_tags : 1) * sizeof(int));
+    if (!v->seg_start || !b.seen || grid_build(&b.grid, map, cam->range_m)) {
+        free(b.seen);
+        memset(v, 0, sizeof(*v));
+        return -1;
+    }
+    for (int t = 0; t < map->n_tags; ++t) b.seen[t] = -1;
+
+    memset(v->seg_start, 0, (n_seg + 1) * sizeof(int));
+    for (int i = 0; i < n_seg; ++i) register_segment(&b, v, i, i, NULL, 1);
+    for (int i = 0; i < n_seg; ++i) v->seg_start[i+1] += v->seg_start[i];
+    v->n_entries = v->seg_start[n_seg];
+
+    v->tags = arena_alloc(arena, (v->n_entries ? v->n_entries : 1) * sizeof(int));
+    if (!v->tags) {
+        grid_free(&b.grid);
+        free(b.seen);
+        memset(v, 0, sizeof(*v));
+        return -1;
+    }
+    for (int i = 0; i < n_seg; ++i) {
+        int fill = v->seg_start[i];
+        register_segment(&b, v, i, n_seg + i, &fill, 0);
+    }
+    v->n_seg = n_seg;
+
+    grid_free(&b.grid);
+    free(b.seen);
+    return 0;
+}
+
+
+int tag_visibility_get(const tag_visibility_t* v, int seg, const int** tags)
+{
+    if (!v->seg_start || seg < 0 || seg >= v->n_seg) return -1;
+    *tags = &v->tags[v->seg_start[seg]];
+    return v->seg_start[seg+1] - v->seg_start[seg];
+}
+
+
+int tag_visibility_expects(const tag_visibility_t* v, int seg, int tag)
+{
+    const int* tags;
+    int n = tag_visibility_get(v, seg, &tags);
+    for (int k = 0; k < n; ++k) {
+        if (tags[k] == tag) return 1;
+    }
+    return 0;
+}
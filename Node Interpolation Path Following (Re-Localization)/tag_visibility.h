@@ -0,0 +1,63 @@
+#ifndef TAG_VISIBILITY_H
+#define TAG_VISIBILITY_H
+
+#include "arena.h"
+#include "path_segments.h"
+#include "tag_map.h"
+
+/**
+ * Tags expected in view from each segment of a mission path.
+ *
+ * Built once per mission from the path, the tag map and the camera
+ * extrinsics. Setpoints are flown level at zero yaw in the path frame, so the
+ * camera pose anywhere along the path is known ahead of time. Relocalization
+ * stops turn away from that heading and are not predicted. Each segment
+ * is sampled, padded by VIS_PAD_M either side for detection latency and
+ * tracking error, and every tag inside the camera's field of view and range
+ * from some sample is listed for it.
+ *
+ * Lists are stored CSR-style, segment offsets plus one flat array of tag
+ * indices, so looking up a segment's candidates is two loads and the whole
+ * table is two allocations from the mission arena.
+ */
+
+typedef struct tag_camera_t {
+    float R_cam_to_body[3][3];
+    float T_cam_wrt_body[3];
+    float fov_rad;          // full field of view, a cone about the optical axis
+    float range_m;          // farthest a tag is detected from
+} tag_camera_t;
+
+typedef struct tag_visibility_t {
+    int n_seg;
+    int* seg_start;         // n_seg+1 offsets into tags, NULL when not built
+    int* tags;              // indices into the tag map's tags
+    int n_entries;
+} tag_visibility_t;
+
+
+/**
+ * @brief      list the tags visible from every segment of p
+ *
+ * @param[in]  arena  storage for the table, released with it
+ *
+ * @return     0 on success, -1 on failure
+ */
+int tag_visibility_build(tag_visibility_t* v, const path_t* p, const tag_map_t* map,
+                         const tag_camera_t* cam, arena_t* arena);
+
+/**
+ * @brief      tags expected from segment seg
+ *
+ * @param[out] tags  indices into the tag map's tags
+ *
+ * @return     number of tags, -1 if seg is out of range
+ */
+int tag_visibility_get(const tag_visibility_t* v, int seg, const int** tags);
+
+/**
+ * @brief      is the tag at index tag in the map expected from segment seg
+ */
+int tag_visibility_expects(const tag_visibility_t* v, int seg, int tag);
+
+#endif // TAG_VISIBILITY_H
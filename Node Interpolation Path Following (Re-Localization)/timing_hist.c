@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "timing_hist.h"
+
+static int bucket_of(int64_t ns)
+{
+    if (ns < TIMING_HIST_SUB) return ns < 0 ? 0 : (int)ns;
+
+    int msb = 63 - __builtin_clzll((unsigned long long)ns);
+    int shift = msb - TIMING_HIST_SUB_BITS;
+    int k = TIMING_HIST_SUB + shift * TIMING_HIST_SUB + (int)(ns >> shift) - TIMING_HIST_SUB;
+    return k < TIMING_HIST_BUCKETS ? k : TIMING_HIST_BUCKETS - 1;
+}
+
+// largest value that lands in bucket k
+static int64_t bucket_top(int k)
+{
+    if (k < TIMING_HIST_SUB) return k;
+    int shift = (k - TIMING_HIST_SUB) / TIMING_HIST_SUB;
+    int sub = (k - TIMING_HIST_SUB) % TIMING_HIST_SUB;
+    return ((int64_t)(TIMING_HIST_SUB + sub + 1) << shift) - 1;
+}
+
+
+void timing_hist_record(timing_hist_t* h, int64_t ns)
+{
+    int k = bucket_of(ns);
+    // single writer, a plain atomic store is enough to not tear for readers
+    __atomic_store_n(&h->bucket[k], h->bucket[k] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->n, h->n + 1, __ATOMIC_RELAXED);
+    if (ns > h->max_ns) __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+}
+
+
+void timing_hist_reset(timing_hist_t* h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+
+int64_t timing_hist_percentile(const timing_hist_t* h, double p)
+{
+    uint32_t n = __atomic_load_n(&h->n, __ATOMIC_RELAXED);
+    if (n == 0) return 0;
+
+    uint64_t target = (uint64_t)(p * n + 0.5);
+    if (target < 1) target = 1;
+    int64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    uint64_t seen = 0;
+    for (int k = 0; k < TIMING_HIST_BUCKETS; ++k) {
+        seen += __atomic_load_n(&h->bucket[k], __ATOMIC_RELAXED);
+        if (seen >= target) return bucket_top(k) < max ? bucket_top(k) : max;
+    }
+    return max;
+}
+
+
+void timing_hist_print(const timing_hist_t* h, const char* name)
+{
+    printf("%-14s n:%-8u p50:%8.1f p90:%8.1f p99:%8.1f p99.9:%8.1f max:%8.1f us\n", name,
+           __atomic_load_n(&h->n, __ATOMIC_RELAXED),
+           (double)timing_hist_percentile(h, 0.5) * 1e-3,
+           (double)timing_hist_percentile(h, 0.9) * 1e-3,
+           (double)timing_hist_percentile(h, 0.99) * 1e-3,
+           (double)timing_hist_percentile(h, 0.999) * 1e-3,
+           (double)__atomic_load_n(&h->max_ns, __ATOMIC_RELAXED) * 1e-3);
+}
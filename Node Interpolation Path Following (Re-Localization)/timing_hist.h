@@ -0,0 +1,47 @@
+#ifndef TIMING_HIST_H
+#define TIMING_HIST_H
+
+#include <stdint.h>
+
+/**
+ * Log-linear histogram of durations, HDR histogram style.
+ *
+ * Every power of two range of nanoseconds is split into TIMING_HIST_SUB
+ * equal buckets, so any value is kept to within 1/TIMING_HIST_SUB of itself
+ * from nanoseconds up to minutes in a fixed 1.2KB, with no allocation and a
+ * handful of integer operations per sample. Percentiles report the top of
+ * the bucket they fall in, capped at the largest sample, so they are never
+ * less than the true value.
+ *
+ * One thread records. Other threads may read at any time, counters are
+ * updated atomically so a reader sees each one whole, though a sample being
+ * recorded may show in some counters and not yet in others.
+ */
+
+#define TIMING_HIST_SUB_BITS 3
+#define TIMING_HIST_SUB (1 << TIMING_HIST_SUB_BITS)
+#define TIMING_HIST_MAX_BITS 40     // values from 2^40ns (~18min) up share the top bucket
+#define TIMING_HIST_BUCKETS ((TIMING_HIST_MAX_BITS - TIMING_HIST_SUB_BITS + 1) * TIMING_HIST_SUB)
+
+typedef struct timing_hist_t {
+    uint32_t bucket[TIMING_HIST_BUCKETS];
+    uint32_t n;
+    int64_t max_ns;
+} timing_hist_t;
+
+
+// from the recording thread only
+void timing_hist_record(timing_hist_t* h, int64_t ns);
+void timing_hist_reset(timing_hist_t* h);
+
+/**
+ * @brief      value at or below which a fraction p of the samples fall
+ *
+ * @return     nanoseconds, 0 if nothing is recorded
+ */
+int64_t timing_hist_percentile(const timing_hist_t* h, double p);
+
+// one line: name, sample count and p50/p90/p99/p99.9/max in microseconds
+void timing_hist_print(const timing_hist_t* h, const char* name);
+
+#endif // TIMING_HIST_H